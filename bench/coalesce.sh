@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Login storm benchmark: start N cknfs at once against one stub NFS
+# server, without and with -S, and report wall time, the number of
+# NULL calls the server saw and how many runs kept the path.
+#
+# Must run as root: the stub binds the portmapper port.  The fake
+# mount table is given with -M.
+#
+# Usage: bench/coalesce.sh [nprocs] [server delay in ms]
+
+N=${1:-500}
+DELAY=${2:-10}
+CKNFS=`pwd`/cknfs
+STUB=`pwd`/bench/stubnfs
+
+tmp=`mktemp -d /tmp/cknfs-bench.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+mkdir $tmp/export
+echo "127.0.0.1:/export $tmp/export nfs rw,vers=3,proto=tcp,mountaddr=127.0.0.1 0 0" \
+	> $tmp/mtab
+
+storm() {
+	# $1 is a label, $2 extra cknfs options
+	$STUB -d $DELAY 2> $tmp/stub.out &
+	stub=$!
+	sleep 1
+	start=`date +%s%N`
+	i=0 pids=
+	while [ $i -lt $N ]; do
+		$CKNFS -q -M $tmp/mtab $2 $tmp/export > $tmp/out.$i 2>/dev/null &
+		pids="$pids $!"
+		i=`expr $i + 1`
+	done
+	wait $pids
+	end=`date +%s%N`
+	kill $stub
+	wait $stub 2>/dev/null
+	kept=`cat $tmp/out.* | grep -c export`
+	calls=`sed -n 's/stubnfs: \([0-9]*\) NULL calls/\1/p' $tmp/stub.out`
+	printf "%-12s %4d procs %6d ms %6s NULL calls %4d kept path\n" \
+		"$1" $N `expr \( $end - $start \) / 1000000` \
+		"$calls" $kept
+	rm -f $tmp/out.*
+}
+
+storm plain ""
+storm coalesced "-S $tmp/state"
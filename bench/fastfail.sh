@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Fast failure benchmark: probe servers that fail in different ways,
+# over TCP and UDP, and report how long each probe took and the reason
+# cknfs gave with -v.  Only a server that doesn't answer at all should
+# take the whole timeout.
+#
+#	refused		nothing listens on the NFS port of 127.0.0.1
+#	no route	an unreachable route in our own table
+#	prohibited	a prohibit route
+#	timeout		a stopped stub NFS server on 127.0.0.2
+#
+# Must run as root, to add the routes.  Set CKNFS to compare another
+# build.
+#
+# Usage: bench/fastfail.sh [timeout in seconds]
+
+T=${1:-5}
+CKNFS=${CKNFS:-`pwd`/cknfs}
+STUB=`pwd`/bench/stubnfs
+
+tmp=`mktemp -d /tmp/cknfs-fastfail.XXXXXX` || exit 1
+mkdir $tmp/export
+ip route add unreachable 198.51.100.1/32 || exit 1
+ip route add prohibit 198.51.100.2/32
+$STUB -a 127.0.0.2 -P 0 2> /dev/null &
+stub=$!
+trap 'kill -CONT $stub; kill $stub
+	ip route del unreachable 198.51.100.1/32
+	ip route del prohibit 198.51.100.2/32
+	rm -rf $tmp' 0
+sleep 1
+kill -STOP $stub
+
+probe() {
+	# $1 is a label, $2 the server address, $3 the protocol
+	echo "$2:/export $tmp/export nfs4 rw,vers=4,proto=$3,addr=$2 0 0" \
+		> $tmp/mtab
+	start=`date +%s%N`
+	$CKNFS -v -t $T -M $tmp/mtab $tmp/export > /dev/null 2> $tmp/err
+	end=`date +%s%N`
+	printf "%-10s %-3s %6d ms  %s\n" "$1" $3 \
+		`expr \( $end - $start \) / 1000000` \
+		"`sed -n 's/.* failed, //p' $tmp/err`"
+}
+
+for proto in tcp udp; do
+	probe refused 127.0.0.1 $proto
+	probe "no route" 198.51.100.1 $proto
+	probe prohibited 198.51.100.2 $proto
+	probe timeout 127.0.0.2 $proto
+done
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Fast start benchmark: exec to exit time of cknfs on an all-local
+# PATH, the case of every shell prompt and login, for the normal build
+# and the fast-start one (make fast), which loads the RPC library only
+# when a server has to be probed.  /bin/true is the floor, what any
+# program costs to start here.  The second table has 1000 NFS mounts
+# the PATH doesn't touch, whose addresses are resolved only if probed.
+# Times are medians over the runs, timed by bench/spawn.
+#
+# Usage: bench/faststart.sh [runs]
+
+RUNS=${1:-1000}
+SPAWN=`pwd`/bench/spawn
+
+tmp=`mktemp -d /tmp/cknfs-faststart.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+
+PATHDIRS="/usr/local/sbin /usr/local/bin /usr/sbin /usr/bin /sbin /bin"
+awk -v t=$tmp 'BEGIN {
+	for (i = 0; i < 1000; i++)
+		printf "srv%d:/export %s/m/%d nfs rw,vers=3,proto=tcp,mountaddr=10.0.%d.%d 0 0\n",
+			i, t, i, i / 256, i % 256 > t "/mtab"
+}'
+
+timeit() {
+	# $1 is a label, the rest the command
+	label=$1
+	shift
+	$SPAWN $RUNS "$@" | awk '{ printf "%-26s %6d us median %6d us min\n",
+		"'"$label"'", $5, $8 }'
+}
+
+timeit true /bin/true
+for prog in cknfs cknfs-fast; do
+	timeit "$prog" `pwd`/$prog -s $PATHDIRS
+	timeit "$prog 1000 nfs mounts" `pwd`/$prog -s -M $tmp/mtab $PATHDIRS
+done
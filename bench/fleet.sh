@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Fleet benchmark: a synthetic mount table of many NFS mounts over many
+# servers, read with -M, and server verdicts replayed with -p, so no NFS
+# server (and no root) is needed and every run gives the same answer.
+# Reports the time to start and parse the mount table, and the time to
+# check a PATH of 200 directories spread over the fleet.
+#
+# Usage: bench/fleet.sh [iterations] [mounts] [servers]
+
+ITER=${1:-20}
+MOUNTS=${2:-10000}
+SERVERS=${3:-500}
+CKNFS=`pwd`/cknfs
+
+tmp=`mktemp -d /tmp/cknfs-fleet.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+
+# mount i is export i of server i % SERVERS, every 20th server is dead
+awk -v m=$MOUNTS -v s=$SERVERS -v t=$tmp 'BEGIN {
+	for (i = 0; i < m; i++) {
+		h = i % s
+		printf "srv%d:/export/%d %s/m/%d nfs rw,vers=3,proto=tcp,mountaddr=10.%d.%d.%d 0 0\n",
+			h, i, t, i, h / 65536 % 256, h / 256 % 256, h % 256 > t "/mtab"
+		print t "/m/" i "/bin" > t "/dirs"
+	}
+	for (h = 0; h < s; h++)
+		printf "srv%d %d %d 0\n", h, h % 20 != 0, h * 7 % 40 > t "/replay"
+	for (i = 0; i < 200; i++)
+		printf "%s%s/m/%d/bin", i ? ":" : "", t, i * 51 % m > t "/path"
+}'
+xargs mkdir -p < $tmp/dirs
+
+timeit() {
+	# $1 is a label, the rest the cknfs arguments
+	label=$1
+	shift
+	start=`date +%s%N`
+	i=0
+	while [ $i -lt $ITER ]; do
+		$CKNFS "$@" > $tmp/out 2>/dev/null
+		i=`expr $i + 1`
+	done
+	end=`date +%s%N`
+	printf "%-8s %6d mounts %4d servers %8.2f ms/run %4d good paths\n" \
+		$label $MOUNTS $SERVERS \
+		`expr \( $end - $start \) / $ITER / 10000`e-2 \
+		`tr ':' '\n' < $tmp/out | grep -c bin`
+}
+
+timeit parse -M $tmp/mtab $tmp
+timeit check -s -M $tmp/mtab -p $tmp/replay `cat $tmp/path`
+timeit ordered -o -s -M $tmp/mtab -p $tmp/replay `cat $tmp/path`
@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# Gossip test on loopback: N cknfs watchers share verdicts with -g.
+# One of them has a short timeout.  The stub NFS server is frozen, and
+# we measure how long the other watchers, whose own probes would take
+# 20 seconds to time out, take to mark the server dead from its report.
+# One more watcher has the wrong key and must ignore everybody.
+#
+# Uses NFS version 4, so the stub runs without a portmapper and
+# without root.
+#
+# Usage: bench/gossip.sh [watchers]
+
+N=${1:-10}
+CKNFS=`pwd`/cknfs
+STUB=`pwd`/bench/stubnfs
+BASE=7100
+
+tmp=`mktemp -d /tmp/cknfs-gossip.XXXXXX` || exit 1
+mkdir $tmp/export
+echo "127.0.0.1:/export $tmp/export nfs4 rw,vers=4,proto=tcp,addr=127.0.0.1 0 0" \
+	> $tmp/mtab
+head -c 32 /dev/urandom > $tmp/key
+head -c 32 /dev/urandom > $tmp/badkey
+
+peers=
+i=0
+while [ $i -le $N ]; do
+	peers="$peers,127.0.0.1:`expr $BASE + $i`"
+	i=`expr $i + 1`
+done
+
+$STUB -P 0 2> /dev/null &
+stub=$!
+trap 'kill -CONT $stub; kill $pids $stub 2>/dev/null; rm -rf $tmp' 0
+sleep 1
+
+# watcher 0 finds out by itself in a second, watcher N has the wrong key
+pids=
+i=0
+while [ $i -le $N ]; do
+	t=20 key=$tmp/key
+	[ $i -eq 0 ] && t=1
+	[ $i -eq $N ] && key=$tmp/badkey
+	$CKNFS -w 2 -t $t -M $tmp/mtab -K $key \
+		-g 127.0.0.1:`expr $BASE + $i`$peers > $tmp/out.$i 2>&1 &
+	pids="$pids $!"
+	i=`expr $i + 1`
+done
+sleep 3
+
+kill -STOP $stub
+start=`date +%s%N`
+# wait for watcher 0, then for the others to hear from it
+while ! grep -q down $tmp/out.0; do
+	sleep 0.01
+done
+found=`date +%s%N`
+tries=0
+while [ `cat $tmp/out.* | grep -c "(peer"` -lt `expr $N - 1` -a $tries -lt 500 ]; do
+	sleep 0.01
+	tries=`expr $tries + 1`
+done
+heard=`date +%s%N`
+
+printf "%d watchers: own probe found it dead after %d ms, %d of %d peers knew %d ms later\n" \
+	$N `expr \( $found - $start \) / 1000000` \
+	`cat $tmp/out.* | grep -c "(peer"` `expr $N - 1` \
+	`expr \( $heard - $found \) / 1000000`
+printf "watcher with the wrong key: %d verdicts taken\n" \
+	`grep -c "(peer" $tmp/out.$N`
@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Prompt hook benchmark: what running cknfs on every prompt costs,
+# checking the whole PATH each time versus the incremental mode (-i)
+# once its state file is written.  The mount table is a synthetic one
+# given with -M, and server verdicts are replayed with -p, so no NFS
+# server is needed.  Times are per run, from which the time to start
+# /bin/true is subtracted.  The "startup" line is cknfs exiting at
+# once (usage message), what is above it is the real work.
+#
+# Usage: bench/prompt.sh [iterations] [mounts] [path entries]
+
+ITER=${1:-200}
+MOUNTS=${2:-1000}
+NPATH=${3:-30}
+CKNFS=`pwd`/cknfs
+
+tmp=`mktemp -d /tmp/cknfs-prompt.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+
+awk -v m=$MOUNTS -v n=$NPATH -v t=$tmp 'BEGIN {
+	for (i = 0; i < m; i++) {
+		h = i % 50
+		printf "srv%d:/export/%d %s/m/%d nfs rw,vers=3,proto=tcp,mountaddr=10.0.0.%d 0 0\n",
+			h, i, t, i, h + 1 > t "/mtab"
+	}
+	for (h = 0; h < 50; h++)
+		printf "srv%d %d %d 0\n", h, h != 7, h % 10 > t "/replay"
+	for (i = 0; i < n; i++) {
+		d = t "/m/" i * 7 % m "/bin"
+		print d > t "/dirs"
+		printf "%s%s", i ? ":" : "", d > t "/path"
+	}
+}'
+xargs mkdir -p < $tmp/dirs
+PATHLIST=`cat $tmp/path`
+
+timeit() {
+	# $* is the command; prints us per run
+	start=`date +%s%N`
+	i=0
+	while [ $i -lt $ITER ]; do
+		"$@" > /dev/null 2>&1
+		i=`expr $i + 1`
+	done
+	end=`date +%s%N`
+	expr \( $end - $start \) / $ITER / 1000
+}
+
+base=`timeit /bin/true`
+start=`timeit $CKNFS`
+full=`timeit $CKNFS -s -M $tmp/mtab -p $tmp/replay $PATHLIST`
+$CKNFS -s -i $tmp/state -M $tmp/mtab -p $tmp/replay $PATHLIST > /dev/null 2>&1
+inc=`timeit $CKNFS -s -i $tmp/state -M $tmp/mtab -p $tmp/replay $PATHLIST`
+a=`$CKNFS -s -M $tmp/mtab -p $tmp/replay $PATHLIST 2>/dev/null`
+b=`$CKNFS -s -i $tmp/state -M $tmp/mtab -p $tmp/replay $PATHLIST 2>/dev/null`
+
+printf "%-12s %5d mounts %3d paths %7d us/run\n" \
+	startup $MOUNTS $NPATH `expr $start - $base` \
+	full $MOUNTS $NPATH `expr $full - $base` \
+	incremental $MOUNTS $NPATH `expr $inc - $base`
+[ "$a" = "$b" ] && echo "same answer" || echo "DIFFERENT ANSWER"
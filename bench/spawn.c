@@ -0,0 +1,72 @@
+/* -*- mode: c; c-basic-offset: 8 -*- */
+/*
+ * spawn - time a program from exec to exit
+ *
+ * Runs the command n times with posix_spawn, its output going to
+ * /dev/null, waiting for each, and prints the median and the fastest
+ * run in microseconds:
+ *
+ *	spawn: 1000 runs median 742 us min 655 us
+ *
+ * A shell loop costs more than the program we want to measure, this
+ * costs one vfork-like clone and the wait.
+ *
+ * Usage: spawn n command [args...]
+ * Build: cc -o spawn spawn.c
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int
+cmp(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int
+main(int argc, char **argv)
+{
+	posix_spawn_file_actions_t fa;
+	struct timespec t0, t1;
+	long *us;
+	int i, n, status;
+	pid_t pid;
+
+	if (argc < 3 || (n = atoi(argv[1])) < 1) {
+		fprintf(stderr, "usage: spawn n command [args...]\n");
+		return 2;
+	}
+	us = malloc(n * sizeof(*us));
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+	for (i = 0; i < n; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (posix_spawn(&pid, argv[2], &fa, NULL, argv + 2, environ) != 0) {
+			perror(argv[2]);
+			return 1;
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			perror("waitpid");
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		us[i] = (t1.tv_sec - t0.tv_sec) * 1000000L +
+			(t1.tv_nsec - t0.tv_nsec) / 1000;
+	}
+	qsort(us, n, sizeof(*us), cmp);
+	printf("spawn: %d runs median %ld us min %ld us\n", n, us[n / 2], us[0]);
+	return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Startup benchmark: time to read a large mount table, parsing it
+# every time versus mapping the snapshot kept with -m.  The mount
+# table is a synthetic one given with -M, and the only path checked
+# is local, so the run is nothing but startup.  One more run checks
+# that an NFS path gives the same answer both ways.
+#
+# Usage: bench/startup.sh [iterations] [mounts] [servers]
+
+ITER=${1:-20}
+MOUNTS=${2:-10000}
+SERVERS=${3:-500}
+CKNFS=`pwd`/cknfs
+
+tmp=`mktemp -d /tmp/cknfs-startup.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+
+awk -v m=$MOUNTS -v s=$SERVERS -v t=$tmp 'BEGIN {
+	for (i = 0; i < m; i++) {
+		h = i % s
+		printf "srv%d:/export/%d %s/m/%d nfs rw,vers=3,proto=tcp,mountaddr=10.%d.%d.%d 0 0\n",
+			h, i, t, i, h / 65536 % 256, h / 256 % 256, h % 256 > t "/mtab"
+	}
+	for (h = 0; h < s; h++)
+		printf "srv%d %d %d 0\n", h, h % 20 != 0, h * 7 % 40 > t "/replay"
+}'
+
+timeit() {
+	# $1 is a label, the rest the cknfs arguments
+	label=$1
+	shift
+	start=`date +%s%N`
+	i=0
+	while [ $i -lt $ITER ]; do
+		$CKNFS "$@" > /dev/null 2>&1
+		i=`expr $i + 1`
+	done
+	end=`date +%s%N`
+	printf "%-9s %6d mounts %8.2f ms/run\n" $label $MOUNTS \
+		`expr \( $end - $start \) / $ITER / 10000`e-2
+}
+
+timeit parse -M $tmp/mtab $tmp
+$CKNFS -m $tmp/snap -M $tmp/mtab $tmp > /dev/null
+timeit snapshot -m $tmp/snap -M $tmp/mtab $tmp
+printf "%-9s %6d mounts %8d bytes\n" size $MOUNTS `wc -c < $tmp/snap`
+
+# same verdicts on a dead and a live server's mount
+mkdir -p $tmp/m/0/bin $tmp/m/1/bin
+a=`$CKNFS -s -p $tmp/replay -M $tmp/mtab $tmp/m/0/bin $tmp/m/1/bin 2>/dev/null`
+b=`$CKNFS -s -p $tmp/replay -m $tmp/snap -M $tmp/mtab $tmp/m/0/bin $tmp/m/1/bin 2>/dev/null`
+[ "$a" = "$b" ] && echo "same answer: $a" || echo "DIFFERENT: '$a' '$b'"
@@ -0,0 +1,307 @@
+/* -*- mode: c; c-basic-offset: 8 -*- */
+/*
+ * stubnfs - minimal NFS and portmapper responder for benchmarking cknfs
+ *
+ * Answers NULLPROC for the NFS program (versions 2-4) on TCP and UDP,
+ * and PMAPPROC_GETPORT on the portmapper port, without registering
+ * anything with the system portmapper.  It serves no files, but
+ * answers v3 FSINFO and v4 COMPOUND with success, and the mount
+ * daemon's MNT with a dummy file handle, for cknfs -R.
+ *
+ * Usage: stubnfs [-a addr] [-p nfsport] [-P pmapport] [-d delay] [-o delay]
+ *
+ *	 -a addr	address to listen on (default 127.0.0.1), 0.0.0.0
+ *			to answer for every loopback address
+ *	 -p port	NFS and mount port (default 2049)
+ *	 -P port	portmapper port (default 111, 0 to disable)
+ *	 -d ms		delay every NFS reply by ms milliseconds
+ *	 -o ms		delay replies to real operations (not NULL) by ms
+ *
+ * The number of NULL calls received is printed on stderr when the
+ * stub gets SIGTERM or SIGINT.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define PORTMAP
+#include <rpc/rpc.h>
+#include <rpc/pmap_prot.h>
+
+#define NFS_PROGRAM 100003L
+#define MOUNTPROG 100005L
+
+static struct in_addr listen_addr;
+static int nfs_port = 2049;
+static int pmap_port = PMAPPORT;
+static int delay, opdelay;
+static unsigned long nullcalls;
+
+static void
+done(signum)
+	int signum;
+{
+	char msg[64];
+
+	snprintf(msg, sizeof(msg), "stubnfs: %lu NULL calls\n", nullcalls);
+	write(2, msg, strlen(msg));
+	_exit(0);
+}
+
+static int
+bound_socket(type, port)
+/*
+ * Return a socket of type bound to listen_addr:port
+ */
+	int type, port;
+{
+	struct sockaddr_in sin;
+	int sock, on = 1;
+
+	if ((sock = socket(PF_INET, type, 0)) < 0) {
+		perror("socket");
+		exit(1);
+	}
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+	/* several stubs can share the address, for bench/sweep.sh */
+	setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr = listen_addr;
+	sin.sin_port = htons(port);
+	if (bind(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		fprintf(stderr, "bind %s:%d: %s\n", inet_ntoa(listen_addr),
+			port, strerror(errno));
+		exit(1);
+	}
+	if (type == SOCK_STREAM)
+		listen(sock, 1024);
+	return sock;
+}
+
+static void
+pause_ms(ms)
+	int ms;
+{
+	struct timeval tv;
+
+	if (ms <= 0)
+		return;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	select(0, NULL, NULL, NULL, &tv);
+}
+
+static bool_t
+xdr_fsinfo_ok(xdrs, arg)
+/*
+ * FSINFO3resok with no attributes and all fields zero
+ */
+	XDR *xdrs;
+	void *arg;
+{
+	u_int word = 0;
+	int i;
+
+	for (i = 0; i < 14; i++)
+		if (!xdr_u_int(xdrs, &word))
+			return FALSE;
+	return TRUE;
+}
+
+static bool_t
+xdr_compound_ok(xdrs, arg)
+/*
+ * COMPOUND4res for PUTROOTFH, GETATTR(type) saying it's a directory
+ */
+	XDR *xdrs;
+	void *arg;
+{
+	static u_int words[] = {
+		0, 0,		/* NFS4_OK, empty tag */
+		2,		/* two results */
+		24, 0,		/* PUTROOTFH ok */
+		9, 0, 1, 2,	/* GETATTR ok, bitmap { type } */
+		4, 2		/* attrlist: NF4DIR */
+	};
+	int i;
+
+	for (i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		if (!xdr_u_int(xdrs, &words[i]))
+			return FALSE;
+	return TRUE;
+}
+
+static bool_t
+xdr_mnt_ok(xdrs, arg)
+/*
+ * mountres3 with an 8 byte file handle and AUTH_SYS
+ */
+	XDR *xdrs;
+	void *arg;
+{
+	u_int status = 0, flavors = 1, flavor = 1;
+	char fh[8], *fhp = fh;
+	u_int fhlen = sizeof(fh);
+
+	memset(fh, 0x5a, sizeof(fh));
+	return xdr_u_int(xdrs, &status) &&
+		xdr_bytes(xdrs, &fhp, &fhlen, sizeof(fh)) &&
+		xdr_u_int(xdrs, &flavors) && xdr_u_int(xdrs, &flavor);
+}
+
+static void
+nfs_dispatch(rqstp, transp)
+	struct svc_req *rqstp;
+	SVCXPRT *transp;
+{
+	pause_ms(delay);
+	if (rqstp->rq_proc != NULLPROC)
+		pause_ms(opdelay);
+	switch (rqstp->rq_proc) {
+	case NULLPROC:
+		++nullcalls;
+		svc_sendreply(transp, (xdrproc_t)xdr_void, NULL);
+		break;
+	case 1:		/* v4 COMPOUND */
+		if (rqstp->rq_vers != 4)
+			goto noproc;
+		svc_sendreply(transp, (xdrproc_t)xdr_compound_ok, NULL);
+		break;
+	case 19:	/* v3 FSINFO */
+		if (rqstp->rq_vers != 3)
+			goto noproc;
+		svc_sendreply(transp, (xdrproc_t)xdr_fsinfo_ok, NULL);
+		break;
+	default:
+	noproc:
+		svcerr_noproc(transp);
+	}
+}
+
+static void
+mount_dispatch(rqstp, transp)
+	struct svc_req *rqstp;
+	SVCXPRT *transp;
+{
+	switch (rqstp->rq_proc) {
+	case NULLPROC:
+	case 3:		/* UMNT */
+		svc_sendreply(transp, (xdrproc_t)xdr_void, NULL);
+		break;
+	case 1:		/* MNT */
+		svc_sendreply(transp, (xdrproc_t)xdr_mnt_ok, NULL);
+		break;
+	default:
+		svcerr_noproc(transp);
+	}
+}
+
+static void
+pmap_dispatch(rqstp, transp)
+	struct svc_req *rqstp;
+	SVCXPRT *transp;
+{
+	struct pmap pmap;
+	u_long port;
+
+	switch (rqstp->rq_proc) {
+	case NULLPROC:
+		svc_sendreply(transp, (xdrproc_t)xdr_void, NULL);
+		break;
+	case PMAPPROC_GETPORT:
+		memset(&pmap, 0, sizeof(pmap));
+		if (!svc_getargs(transp, (xdrproc_t)xdr_pmap, (caddr_t)&pmap)) {
+			svcerr_decode(transp);
+			break;
+		}
+		port = pmap.pm_prog == NFS_PROGRAM ||
+			pmap.pm_prog == MOUNTPROG ? nfs_port : 0;
+		svc_sendreply(transp, (xdrproc_t)xdr_u_long, (caddr_t)&port);
+		break;
+	default:
+		svcerr_noproc(transp);
+	}
+}
+
+static void
+serve(xprt, prog, vers, dispatch)
+	SVCXPRT *xprt;
+	u_long prog, vers;
+	void (*dispatch)();
+{
+	if (xprt == NULL) {
+		fprintf(stderr, "stubnfs: cannot create service\n");
+		exit(1);
+	}
+	/* protocol 0: don't tell the system portmapper */
+	if (!svc_register(xprt, prog, vers, dispatch, 0)) {
+		fprintf(stderr, "stubnfs: cannot register %lu/%lu\n", prog, vers);
+		exit(1);
+	}
+}
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	SVCXPRT *tcp, *udp, *pm;
+	int n, vers;
+
+	listen_addr.s_addr = htonl(INADDR_LOOPBACK);
+	while ((n = getopt(argc, argv, "a:d:o:p:P:")) != EOF)
+		switch (n) {
+		case 'a':
+			if (inet_aton(optarg, &listen_addr) == 0) {
+				fprintf(stderr, "%s: bad address\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'd':	delay = atoi(optarg);
+				break;
+		case 'o':	opdelay = atoi(optarg);
+				break;
+		case 'p':	nfs_port = atoi(optarg);
+				break;
+		case 'P':	pmap_port = atoi(optarg);
+				break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-a addr] [-p nfsport] [-P pmapport] [-d ms] [-o ms]\n",
+				argv[0]);
+			exit(1);
+		}
+
+	signal(SIGTERM, done);
+	signal(SIGINT, done);
+	signal(SIGPIPE, SIG_IGN);
+
+	tcp = svctcp_create(bound_socket(SOCK_STREAM, nfs_port), 0, 0);
+	udp = svcudp_create(bound_socket(SOCK_DGRAM, nfs_port));
+	for (vers = 2; vers <= 4; vers++) {
+		serve(tcp, NFS_PROGRAM, vers, nfs_dispatch);
+		serve(udp, NFS_PROGRAM, vers, nfs_dispatch);
+	}
+	for (vers = 1; vers <= 3; vers++) {
+		serve(tcp, MOUNTPROG, vers, mount_dispatch);
+		serve(udp, MOUNTPROG, vers, mount_dispatch);
+	}
+	if (pmap_port) {
+		pm = svctcp_create(bound_socket(SOCK_STREAM, pmap_port), 0, 0);
+		serve(pm, PMAPPROG, PMAPVERS, pmap_dispatch);
+	}
+	svc_run();
+	fprintf(stderr, "stubnfs: svc_run returned\n");
+	exit(1);
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Sweep benchmark: a fleet of NFS servers on loopback addresses
+# 127.1.x.y, all answered by a few stub NFS servers listening on the
+# wildcard address (one per CPU, sharing the ports), swept with -F and
+# 1, 2, 4... event loops up to twice the number of CPUs.  Reports the
+# wall time, servers per second and how many were found up.  Half the
+# servers are NFS version 3 over TCP, half over UDP, so every probe
+# asks the portmapper first, as for a real v3 fleet.
+#
+# Must run as root: the stubs bind the portmapper port.
+#
+# Usage: bench/sweep.sh [servers] [iterations]
+
+N=${1:-3000}
+ITER=${2:-3}
+CKNFS=`pwd`/cknfs
+STUB=`pwd`/bench/stubnfs
+NCPU=`getconf _NPROCESSORS_ONLN`
+
+tmp=`mktemp -d /tmp/cknfs-sweep.XXXXXX` || exit 1
+awk -v n=$N 'BEGIN {
+	for (i = 0; i < n; i++) {
+		a = sprintf("127.1.%d.%d", i / 250, i % 250 + 1)
+		printf "%s:/export /fleet/%d nfs rw,vers=3,proto=%s,mountaddr=%s 0 0\n",
+			a, i, i % 2 ? "udp" : "tcp", a
+	}
+}' > $tmp/fleet
+
+stubs=
+i=0
+while [ $i -lt $NCPU ]; do
+	$STUB -a 0.0.0.0 2> /dev/null &
+	stubs="$stubs $!"
+	i=`expr $i + 1`
+done
+trap 'kill $stubs; rm -rf $tmp' 0
+sleep 1
+
+loops=1
+while [ $loops -le `expr 2 \* $NCPU` ]; do
+	start=`date +%s%N`
+	i=0
+	while [ $i -lt $ITER ]; do
+		$CKNFS -F -j $loops -M $tmp/fleet > $tmp/out 2>&1
+		i=`expr $i + 1`
+	done
+	end=`date +%s%N`
+	ms=`expr \( $end - $start \) / $ITER / 1000000`
+	printf "%2d cpus %3d loops %6d servers %6d ms %8d servers/s %6d up\n" \
+		$NCPU $loops $N $ms `expr $N \* 1000 / \( $ms + 1 \)` \
+		`grep -c " up " $tmp/out`
+	loops=`expr $loops \* 2`
+done
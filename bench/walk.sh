@@ -0,0 +1,114 @@
+#!/bin/sh
+#
+# Path walk benchmark: run cknfs on synthetic trees that stress the
+# local part of the check (lstat and chdir per component, symbolic
+# link recursion, ".." handling, many paths), with no NFS server
+# involved.  Reports file system calls per path, counted by the
+# bench/syscount.so shim, and nanoseconds per path, for the walker
+# that goes one component at a time and for the io_uring one (-U).
+#
+# The mount table is a fake one, given with -M, with many local and a
+# few unrelated NFS entries, so isnfsmnt() has something to scan.
+#
+# Usage: bench/walk.sh [iterations] [mount table entries]
+
+ITER=${1:-20}
+MOUNTS=${2:-500}
+CKNFS=`pwd`/cknfs
+SHIM=`pwd`/bench/syscount.so
+
+tmp=`mktemp -d /tmp/cknfs-walk.XXXXXX` || exit 1
+trap 'rm -rf $tmp' 0
+t=$tmp/tree
+i=0
+while [ $i -lt $MOUNTS ]; do
+	echo "tmpfs /bench/local$i tmpfs rw 0 0"
+	i=`expr $i + 1`
+done > $tmp/mtab
+i=0
+while [ $i -lt 20 ]; do
+	echo "127.0.0.1:/export$i /bench/nfs$i nfs rw,vers=3,proto=tcp,mountaddr=127.0.0.1 0 0"
+	i=`expr $i + 1`
+done >> $tmp/mtab
+
+# deep: 100 levels of plain directories
+d=$t/deep
+mkdir -p $d
+i=0
+while [ $i -lt 100 ]; do
+	d=$d/d$i
+	i=`expr $i + 1`
+done
+mkdir -p $d
+deep=$d
+
+# symlink: chain of 40 relative links ending in a directory
+mkdir -p $t/sym/end
+i=0
+while [ $i -lt 40 ]; do
+	ln -s l`expr $i + 1` $t/sym/l$i
+	i=`expr $i + 1`
+done
+ln -s end $t/sym/l40
+symlink=$t/sym/l0
+
+# dotdot: 50 rounds of going down two levels and back up
+mkdir -p $t/dd/a/b/c
+dotdot=$t/dd/a
+i=0
+while [ $i -lt 50 ]; do
+	dotdot=$dotdot/b/c/../..
+	i=`expr $i + 1`
+done
+
+# wide: a PATH with 200 directories
+wide=
+i=0
+while [ $i -lt 200 ]; do
+	mkdir -p $t/wide/bin$i
+	wide="$wide $t/wide/bin$i"
+	i=`expr $i + 1`
+done
+
+run() {
+	# $* are the paths; prints "ns calls" for ITER runs
+	start=`date +%s%N`
+	i=0
+	while [ $i -lt $ITER ]; do
+		$CKNFS $ENGINE -q -M $tmp/mtab $* > /dev/null 2>&1
+		i=`expr $i + 1`
+	done
+	end=`date +%s%N`
+	calls=`LD_PRELOAD=$SHIM $CKNFS $ENGINE -q -M $tmp/mtab $* 2>&1 >/dev/null |
+		sed -n 's/^syscount: total \([0-9]*\).*/\1/p'`
+	echo `expr $end - $start` $calls
+}
+
+repeat() {
+	# $1 copies of $2
+	n=0 list=
+	while [ $n -lt $1 ]; do
+		list="$list $2"
+		n=`expr $n + 1`
+	done
+	echo $list
+}
+
+bench() {
+	# $1 is a label, $2 the number of paths, the rest the paths
+	label=$1 npaths=$2
+	shift 2
+	echo "$base" `run $*` | awk '{
+		printf "%-10s %-6s %4d paths %10.0f ns/path %7.1f calls/path\n",
+			"'$label'", "'"${ENGINE:-walk}"'", '$npaths',
+			($3 - $1) / '$ITER' / '$npaths',
+			($4 - $2) / '$npaths' }'
+}
+
+for ENGINE in "" -U; do
+	base=`run /`
+	bench deep 50 `repeat 50 $deep`
+	bench symlink 50 `repeat 50 $symlink`
+	bench dotdot 50 `repeat 50 $dotdot`
+	bench wide 200 $wide
+done
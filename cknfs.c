@@ -14,13 +14,66 @@
  *
  * Usage: cknfs -e -s -t# -u -v -D -L paths
  *
+ *	 -a	arguments are NAME=dir:dir..., print csh (sh with -s)
+ *		assignments of the good directories to each NAME
+ *	 -c file append the outcome of every server probe to file
+ *	 -d s	deadline, whole run must finish within s seconds
  *	 -e	silent, do not print paths
  *	 -f	accept any type of file, not just directories
+ *	 -F	sweep: probe every NFS server in the mount table
+ *		(usually a fleet's exports given with -M) from one
+ *		event loop per CPU, printing each as it completes
+ *	 -g [addr:]port,dest:port,...
+ *		in watch mode, listen for verdicts of other cknfs
+ *		watchers on port and send ours to the destinations
+ *		(broadcast addresses or peers)
+ *	 -G	print the NFS mounts each path depends on, instead
+ *		of the good paths
+ *	 -i file incremental: keep verdicts in file, and only check
+ *		new paths and servers not checked for 10 seconds
+ *		(prompt hooks)
+ *	 -j n	with -F, use n event loops instead of one per CPU
+ *	 -k	keep paths left unchecked when the -d deadline passes
+ *	 -K file key for signing gossip, shared by all watchers
+ *	 -l ms	skip paths whose NFS server takes longer than ms
+ *		milliseconds to answer
+ *	 -m file keep the parsed mount table in file, and map it
+ *		instead of parsing the mount table while it is unchanged
+ *	 -M file read the mount table from file, in mtab or
+ *		/proc/<pid>/mountinfo format
+ *	 -n pids check in the mount namespace of each process in the
+ *		comma separated list, or of every process if "all",
+ *		printing one line per namespace (containers); not
+ *		with -a, -M, -W or -x
+ *	 -o	order output: local paths, then fast NFS, then slow NFS
+ *	 -p file replay probe outcomes recorded with -c instead of
+ *		probing servers
+ *	 -P	profile: print CPU and blocked time, context switches,
+ *		page faults and CPU migrations for each phase of the run
+ *		(mount table, resolve, probe, walk, output) on stderr
+ *	 -r ms,ms...
+ *		UDP retransmit schedule: ms to wait after each NULL
+ *		datagram, the last one repeated until the timeout
+ *		(default 250,500,1000); other calls take the first
+ *		value only
+ *	 -R	after the NULL ping, do a real NFS operation (FSINFO
+ *		or COMPOUND GETATTR) to catch servers with stalled I/O
  *	 -s	print paths in sh format (colons)
+ *	 -S dir	keep server state in dir, so servers found dead
+ *		are skipped by later runs (circuit breaker), and
+ *		the servers each path needs, to probe them first
  *	 -t n	timeout interval before assuming an NFS
  *		server is dead (default 10 seconds)
  *	 -u	unique paths
+ *	 -U	walk all the paths at once with io_uring, each lookup
+ *		with its own timeout (Linux)
  *	 -v	verbose
+ *	 -w n	watch mode, probe all NFS servers every n seconds
+ *		and print state changes
+ *	 -W ms	read good directories in the background for at most
+ *		ms milliseconds, to warm up the client's caches
+ *	 -x file write index of executables in the good paths
+ *	 -X file look up the arguments in such an index
  *	 -D	debug
  *	 -L	expand symbolic links
  *	 -H	print hostname pinged.
@@ -71,6 +124,10 @@
  * Additional modifications made 1990-2006, University of Oslo
  */
 
+#ifdef linux
+/* for statx, AT_NO_AUTOMOUNT and friends */
+# define _GNU_SOURCE
+#endif
 #include <sys/param.h>
 #include <errno.h>
 #include <sys/types.h>
@@ -81,7 +138,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #define PORTMAP
@@ -93,6 +153,49 @@
 #include <setjmp.h>
 #include <assert.h>
 #include <sys/select.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/resource.h>
+#ifdef linux
+#include <sys/syscall.h>
+#include <linux/errqueue.h>
+#endif
+
+/*
+ * Static tracepoints (USDT) for bpftrace, SystemTap and perf, e.g.
+ *
+ *	bpftrace -e 'usdt:./cknfs:cknfs:null__return { @[str(arg0)] = hist(arg2); }'
+ *
+ * They need <sys/sdt.h> (systemtap-sdt-dev or -devel); without it, or
+ * with -DNO_SDT, they compile to nothing.  A probe that is not attached
+ * costs one nop, and without <sys/sdt.h> the clock isn't even read.
+ * Latencies are in microseconds.
+ */
+#if !defined(HAVE_SDT) && !defined(NO_SDT) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  define HAVE_SDT
+# endif
+#endif
+#if defined(HAVE_SDT) && !defined(NO_SDT)
+# include <sys/sdt.h>
+# define TRACE0(name)			DTRACE_PROBE(cknfs, name)
+# define TRACE1(name, a)		DTRACE_PROBE1(cknfs, name, a)
+# define TRACE2(name, a, b)		DTRACE_PROBE2(cknfs, name, a, b)
+# define TRACE3(name, a, b, c)		DTRACE_PROBE3(cknfs, name, a, b, c)
+# define TRACE4(name, a, b, c, d)	DTRACE_PROBE4(cknfs, name, a, b, c, d)
+# define TRACE_US()			now_us()
+#else
+# define TRACE0(name)			((void)0)
+# define TRACE1(name, a)		((void)(a))
+# define TRACE2(name, a, b)		((void)(a), (void)(b))
+# define TRACE3(name, a, b, c)		((void)(a), (void)(b), (void)(c))
+# define TRACE4(name, a, b, c, d)	((void)(a), (void)(b), (void)(c), (void)(d))
+# define TRACE_US()			0L
+#endif
 
 #if defined(sgi)
   /* sgi is missing nfs.h, so we must hardcode the RPC values */
@@ -109,6 +212,87 @@
 # include <nfs/nfs.h>
 #endif
 
+/*
+ * Fast start (make fast, -DLAZY_RPC, libtirpc only).  The program is
+ * not linked with libtirpc, which drags in the Kerberos and GSSAPI
+ * libraries and doubles the time to exec us.  rpc_load() opens it
+ * before the first probe, so a run where every path is local, or
+ * every verdict is known, never loads it.  The RPC calls we make go
+ * through pointers it fills in.
+ */
+#ifdef LAZY_RPC
+# include <dlfcn.h>
+# ifndef RPC_LIBRARY
+#  define RPC_LIBRARY "libtirpc.so.3"
+# endif
+# define RPC_SYMBOLS							\
+	RPC_SYM(__rpc_createerr) RPC_SYM(_null_auth)			\
+	RPC_SYM(_seterr_reply) RPC_SYM(authunix_create_default)	\
+	RPC_SYM(clnt_pcreateerror) RPC_SYM(clnt_perror)			\
+	RPC_SYM(clnt_sperrno) RPC_SYM(clnt_sperror)			\
+	RPC_SYM(clnttcp_create) RPC_SYM(clntudp_create)			\
+	RPC_SYM(xdr_bytes) RPC_SYM(xdr_callmsg) RPC_SYM(xdr_pmap)	\
+	RPC_SYM(xdr_replymsg) RPC_SYM(xdr_string) RPC_SYM(xdr_u_int)	\
+	RPC_SYM(xdr_u_short) RPC_SYM(xdr_void) RPC_SYM(xdrmem_create)
+# define RPC_SYM(name)	static __typeof__(name) *lazy_##name;
+RPC_SYMBOLS
+# undef RPC_SYM
+# define __rpc_createerr		(*lazy___rpc_createerr)
+# define _null_auth			(*lazy__null_auth)
+# define _seterr_reply			(*lazy__seterr_reply)
+# define authunix_create_default	(*lazy_authunix_create_default)
+# define clnt_pcreateerror		(*lazy_clnt_pcreateerror)
+# define clnt_perror			(*lazy_clnt_perror)
+# define clnt_sperrno			(*lazy_clnt_sperrno)
+# define clnt_sperror			(*lazy_clnt_sperror)
+# define clnttcp_create			(*lazy_clnttcp_create)
+# define clntudp_create			(*lazy_clntudp_create)
+# define xdr_bytes			(*lazy_xdr_bytes)
+# define xdr_callmsg			(*lazy_xdr_callmsg)
+# define xdr_pmap			(*lazy_xdr_pmap)
+# define xdr_replymsg			(*lazy_xdr_replymsg)
+# define xdr_string			(*lazy_xdr_string)
+# define xdr_u_int			(*lazy_xdr_u_int)
+# define xdr_u_short			(*lazy_xdr_u_short)
+# define xdr_void			(*lazy_xdr_void)
+# define xdrmem_create			(*lazy_xdrmem_create)
+
+static pthread_once_t rpc_once = PTHREAD_ONCE_INIT;
+static int rpc_loaded;
+
+static void
+rpc_open()
+{
+	void *lib;
+
+	if ((lib = dlopen(RPC_LIBRARY, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return;
+	}
+# define RPC_SYM(name)							\
+	if ((*(void **)&lazy_##name = dlsym(lib, #name)) == NULL) {	\
+		fprintf(stderr, "%s: no %s\n", RPC_LIBRARY, #name);	\
+		return;							\
+	}
+	RPC_SYMBOLS
+# undef RPC_SYM
+	rpc_loaded = 1;
+}
+
+static int
+rpc_load()
+/*
+ * Load the RPC library, once, whichever thread probes first.
+ * Return 1 if ok, 0 if error
+ */
+{
+	(void) pthread_once(&rpc_once, rpc_open);
+	return rpc_loaded;
+}
+#else
+# define rpc_load()	1
+#endif
+
 #define DEFAULT_TIMEOUT 5  /* Default timeout for checking NFS server */
 
 #ifndef __STDC__
@@ -121,6 +305,22 @@ extern char *strchr(), *strrchr(), *strtok();
 # define INADDR_NONE ((unsigned int)-1)
 #endif
 
+/* probe state that watch mode's probe threads each need their own of;
+   without it, watch mode probes one server at a time */
+#ifdef __GNUC__
+# define PER_THREAD	__thread
+#else
+# define PER_THREAD
+# define NO_PER_THREAD
+#endif
+
+#define FHSIZE3		64
+
+struct fhandle3 {
+	u_int len;
+	char data[FHSIZE3];
+};
+
 struct m_mlist {
 	int mlist_checked; /* -1 if bad, 0 if not checked, 1 if ok */
 	struct m_mlist *mlist_next;
@@ -128,18 +328,67 @@ struct m_mlist {
 	char *mlist_fsname;
 	int mlist_isnfs;
 	int mlist_pid;	/* if pid is set, only check automount process */
+	int mlist_autofs;	/* AUTOFS_* if this is an autofs trigger */
+	int mlist_automap;	/* made up from an automount map, not mounted */
 	int nfs_version;
 	int proto;
 	struct addrinfo *mountaddr;
+	char *mlist_addr;	/* mountaddr option, resolved when probed */
+	long mlist_rtt;		/* ms for the NULL call, once checked */
+	long mlist_oprtt;	/* ms for the real operation with -R */
+	struct fhandle3 mlist_fh; /* root of the export, for -R */
+	int mlist_snap;		/* part of a snapshot (-m), not malloced */
 };
 static struct m_mlist *firstmnt;
 
+#define AUTOFS_INDIRECT	1	/* map keys are entries in mlist_dir */
+#define AUTOFS_DIRECT	2	/* map key is mlist_dir itself */
+
 static int errflg;
-static int eflg, fflg, qflg, sflg, vflg, Dflg, Hflg, Lflg, uflg;
+static int aflg, eflg, fflg, kflg, Fflg, Pflg, oflg, qflg, sflg, vflg, Dflg, Gflg, Hflg, Lflg, Rflg, Uflg, uflg;
 static int timeout = DEFAULT_TIMEOUT;
+static long run_deadline; /* -d, all paths must be done by this (ms) */
+static long slice_end;	/* and the current one by this */
+static int slice_cut;	/* the current path timed out at slice_end */
+static int interval;	/* -w, seconds between probes in watch mode */
 static int nfs_version = 3;
 static char prefix[MAXPATHLEN];
+static char *statedir;	/* -S, where to keep server state between runs */
+static long maxrtt;	/* -l, drop paths on servers slower than this (ms) */
+static char *indexfile;	/* -x, write executable index here */
+static char *mtab;	/* -M, read this mount table instead of the system's */
+static char *snapfile;	/* -m, mapped snapshot of the parsed mount table */
+static uint64_t snap_hash;	/* of the mount table when last read */
+static uint32_t snap_tabsize;
+static char *recordfile; /* -c, record probe outcomes here */
+static char *replayfile; /* -p, take probe outcomes from here */
+static char *gossip;	/* -g, [addr:]port,dest:port,... to gossip on */
+static char *keyfile;	/* -K, shared secret for gossip */
+static char nsroot[32];	/* -n, /proc/<pid>/root being checked */
+static char nsmtab[40];	/* and its /proc/<pid>/mountinfo */
+static long warmbudget;	/* -W, ms to spend warming caches of good paths */
+static int path_remote;	/* current path crosses an NFS mount */
+static long path_rtt;	/* and its slowest server answered in this many ms */
+static long path_oprtt;	/* or this many for a real operation (-R) */
+static PER_THREAD const char *probe_fail; /* why the last probe failed, see probe_failed */
+static PER_THREAD int probe_quiet; /* keep this probe's errors to ourselves */
+struct deps {
+	struct m_mlist **m;	/* NFS mounts a path goes through */
+	int n, size;
+};
+static struct deps path_deps;	/* those of the current path */
+#define UDP_SCHED_MAX	16
+static long udp_sched[UDP_SCHED_MAX] = { 250, 500, 1000 }; /* -r, ms */
+static int udp_nsched = 3;
 void mkm_mlist();
+static int snap_load();
+static void snap_write();
+static void snap_unmap();
+static char *state_file();
+static int state_write();
+void nfs_opts();
+const char *find_opt_val();
+void watch();
 
 void *
 xalloc(size)
@@ -157,6 +406,54 @@ int size;
 	return(mem);
 }
 
+static FILE *
+tmp_open(file, tmp, size)
+/*
+ * Create <file>.<pid> in tmp (size bytes) to write the new contents
+ * of file, to be renamed over it.  The file must be new and not a
+ * symbolic link, in case someone left one for us in a shared
+ * directory.  Return NULL, with errno set, if it can't be created
+ */
+const char *file;
+char *tmp;
+int size;
+{
+	FILE *fp;
+	int fd, n, err;
+
+	n = snprintf(tmp, size, "%s.%d", file, (int)getpid());
+	if (n < 0 || n >= size) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	(void) unlink(tmp);	/* ours, from a crashed run */
+	if ((fd = open(tmp, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW, 0666)) < 0)
+		return NULL;
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		err = errno;
+		close(fd);
+		(void) unlink(tmp);
+		errno = err;
+	}
+	return fp;
+}
+
+FILE *
+tmp_create(file, tmp, size)
+/*
+ * tmp_open, with a message if it fails
+ */
+const char *file;
+char *tmp;
+int size;
+{
+	FILE *fp;
+
+	if ((fp = tmp_open(file, tmp, size)) == NULL)
+		perror(errno == ENAMETOOLONG ? file : tmp);
+	return fp;
+}
+
 void *
 xrealloc(orig, size)
 /*
@@ -177,6 +474,353 @@ int size;
 	return(mem);
 }
 
+static long
+now_us()
+/*
+ * Microseconds on a clock that doesn't jump with the time of day
+ */
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+#endif
+}
+
+static long
+now_ms()
+{
+	return now_us() / 1000;
+}
+
+static long long
+wall_ms()
+/*
+ * Milliseconds since the epoch, for state kept between runs
+ */
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static long
+probe_ms()
+/*
+ * How long we may wait for one network operation: -t, but not past
+ * the end of the current path's share of the -d budget
+ */
+{
+	long ms = timeout * 1000L;
+
+	if (slice_end) {
+		if (slice_end - now_ms() < ms)
+			ms = slice_end - now_ms();
+		if (ms < 1)
+			ms = 1;
+	}
+	return ms;
+}
+
+static int
+sliced(fail)
+/*
+ * Return 1 if a wait that ended with fail was cut short by the end
+ * of the current path's share of -d, rather than timing out on -t
+ */
+const char *fail;
+{
+	return fail && strcmp(fail, "timeout") == 0 &&
+		slice_end && now_ms() >= slice_end;
+}
+
+static void
+probe_tv(tv)
+struct timeval *tv;
+{
+	long ms = probe_ms();
+
+	tv->tv_sec = ms / 1000;
+	tv->tv_usec = (ms % 1000) * 1000;
+}
+
+static void
+path_alarm()
+/*
+ * Arm SIGALRM for a path walk: a second more than -t, or the end of
+ * the path's share of -d if that comes first
+ */
+{
+	struct itimerval itv;
+	long ms = timeout * 1000L + 1000;
+
+	if (slice_end && slice_end - now_ms() < ms)
+		ms = slice_end - now_ms();
+	if (ms < 1)
+		ms = 1;
+	memset(&itv, 0, sizeof(itv));
+	itv.it_value.tv_sec = ms / 1000;
+	itv.it_value.tv_usec = (ms % 1000) * 1000;
+	setitimer(ITIMER_REAL, &itv, NULL);
+}
+
+/*
+ * Self-profiling (-P).  The software counters of perf_event_open
+ * (task clock, context switches, page faults, CPU migrations) are read
+ * on entering and leaving each phase of the run, and the difference is
+ * charged to the innermost phase, so a probe made while walking a path
+ * counts as probing, not walking.  Wall time less task clock is the
+ * time spent blocked.  Only the main thread is counted.  When perf
+ * events are not allowed (perf_event_paranoid, seccomp, old kernels),
+ * getrusage gives the same but CPU migrations, at a coarser grain.
+ */
+
+#if defined(linux) && defined(__NR_perf_event_open)
+#include <linux/perf_event.h>
+#endif
+
+#define PROF_OTHER	0
+#define PROF_MTAB	1
+#define PROF_RESOLVE	2
+#define PROF_PROBE	3
+#define PROF_WALK	4
+#define PROF_OUTPUT	5
+#define PROF_NPHASE	6
+
+#define PROF_CPU	0	/* counters: ns on the CPU */
+#define PROF_CSW	1	/* context switches */
+#define PROF_FAULT	2	/* page faults */
+#define PROF_MIGR	3	/* CPU migrations */
+#define PROF_NCOUNT	4
+
+static const char *prof_name[PROF_NPHASE] = {
+	"other", "mount table", "resolve", "probe", "walk", "output"
+};
+static struct {
+	long calls;
+	long long wall;			/* us */
+	long long count[PROF_NCOUNT];
+} prof[PROF_NPHASE];
+static int prof_stack[16], prof_depth;
+static long long prof_last[PROF_NCOUNT + 1];	/* wall (us), then counters */
+static int prof_fd = -1;	/* perf event group leader */
+static int prof_slot[PROF_NCOUNT];	/* index in a group read, or -1 */
+static int prof_have[PROF_NCOUNT];
+static int prof_on;
+static int prof_user;		/* kernel not counted, perf_event_paranoid 2 */
+static pthread_t prof_thread;
+static char prof_why[80];	/* why perf events are not used */
+
+static void
+prof_read(v)
+/*
+ * Current wall time and counters into v
+ */
+long long *v;
+{
+	v[0] = now_us();
+#if defined(linux) && defined(__NR_perf_event_open)
+	if (prof_fd >= 0) {
+		uint64_t buf[1 + PROF_NCOUNT];
+		int i;
+
+		if (read(prof_fd, buf, sizeof(buf)) > 0)
+			for (i = 0; i < PROF_NCOUNT; i++)
+				if (prof_slot[i] >= 0 && prof_slot[i] < buf[0])
+					v[1 + i] = buf[1 + prof_slot[i]];
+		return;
+	}
+#endif
+	{
+		struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+		if (getrusage(RUSAGE_THREAD, &ru) < 0)
+#endif
+			(void) getrusage(RUSAGE_SELF, &ru);
+		v[1 + PROF_CPU] = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) *
+			1000000000LL + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+		v[1 + PROF_CSW] = ru.ru_nvcsw + ru.ru_nivcsw;
+		v[1 + PROF_FAULT] = ru.ru_minflt + ru.ru_majflt;
+	}
+}
+
+static void
+prof_start()
+/*
+ * Open the counters, or fall back on getrusage
+ */
+{
+#if defined(linux) && defined(__NR_perf_event_open)
+	static const int config[PROF_NCOUNT] = {
+		PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_CONTEXT_SWITCHES,
+		PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CPU_MIGRATIONS
+	};
+	struct perf_event_attr attr;
+	int i, fd, slots = 0, user = 0;
+
+	for (i = 0; i < PROF_NCOUNT; i++) {
+		prof_slot[i] = -1;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.config = config[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_hv = 1;
+		/* perf_event_paranoid 2 allows user space only */
+		attr.exclude_kernel = user;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, prof_fd, 0);
+		if (fd < 0 && errno == EACCES && !user && i == 0) {
+			attr.exclude_kernel = user = 1;
+			fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+		if (fd < 0) {
+			if (i == 0) {
+				snprintf(prof_why, sizeof(prof_why),
+					 "perf_event_open: %s", strerror(errno));
+				break;
+			}
+			continue;	/* the rest of the group still works */
+		}
+		if (prof_fd < 0)
+			prof_fd = fd;
+		prof_user = user;
+		prof_slot[i] = slots++;
+		prof_have[i] = 1;
+	}
+#else
+	strcpy(prof_why, "no perf_event_open");
+#endif
+	if (prof_fd < 0) {
+		prof_have[PROF_CPU] = prof_have[PROF_CSW] =
+			prof_have[PROF_FAULT] = 1;
+		prof_have[PROF_MIGR] = 0;
+	}
+	prof_thread = pthread_self();
+	prof_on = 1;
+	prof_depth = 0;
+	prof_stack[0] = PROF_OTHER;
+	prof_read(prof_last);
+}
+
+static void
+prof_charge()
+/*
+ * Charge what was counted since the last call to the current phase
+ */
+{
+	long long v[PROF_NCOUNT + 1];
+	int i, p = prof_stack[prof_depth];
+
+	prof_read(v);
+	prof[p].wall += v[0] - prof_last[0];
+	for (i = 0; i < PROF_NCOUNT; i++)
+		prof[p].count[i] += v[1 + i] - prof_last[1 + i];
+	memcpy(prof_last, v, sizeof(v));
+}
+
+static void
+prof_enter(phase)
+int phase;
+{
+	if (!prof_on || !pthread_equal(pthread_self(), prof_thread) ||
+	    prof_depth == sizeof(prof_stack) / sizeof(prof_stack[0]) - 1)
+		return;
+	prof_charge();
+	prof_stack[++prof_depth] = phase;
+	prof[phase].calls++;
+}
+
+static void
+prof_leave()
+{
+	if (!prof_on || !pthread_equal(pthread_self(), prof_thread) ||
+	    prof_depth == 0)
+		return;
+	prof_charge();
+	prof_depth--;
+}
+
+static void
+prof_unwind(depth)
+/*
+ * Leave the phases entered since prof_depth was depth, which a
+ * longjmp skipped the prof_leave of
+ */
+int depth;
+{
+	if (!prof_on || !pthread_equal(pthread_self(), prof_thread) ||
+	    prof_depth <= depth)
+		return;
+	prof_charge();
+	prof_depth = depth;
+}
+
+static void
+prof_report()
+/*
+ * Print the table of phases on stderr
+ */
+{
+	long long total[PROF_NCOUNT + 1];
+	int i, j;
+
+	if (!prof_on)
+		return;
+	prof_charge();
+	memset(total, 0, sizeof(total));
+	fprintf(stderr, "%-12s %6s %10s %10s %10s %7s %7s %5s\n", "phase",
+		"calls", "wall ms", "cpu ms", "blocked ms", "ctxsw", "faults",
+		"migr");
+	for (i = 0; i <= PROF_NPHASE; i++) {
+		long long wall, *count;
+		const char *name;
+		double blocked;
+
+		if (i < PROF_NPHASE) {
+			if (prof[i].wall == 0 && prof[i].calls == 0)
+				continue;
+			name = prof_name[i];
+			wall = prof[i].wall;
+			count = prof[i].count;
+			total[0] += wall;
+			for (j = 0; j < PROF_NCOUNT; j++)
+				total[1 + j] += count[j];
+			fprintf(stderr, "%-12s %6ld", name, prof[i].calls);
+		} else {
+			wall = total[0];
+			count = total + 1;
+			fprintf(stderr, "%-12s %6s", "total", "");
+		}
+		fprintf(stderr, " %10.2f", wall / 1000.0);
+		/* getrusage counts CPU time in ticks, it can exceed wall */
+		blocked = wall / 1000.0 - count[PROF_CPU] / 1e6;
+		if (prof_have[PROF_CPU])
+			fprintf(stderr, " %10.2f %10.2f", count[PROF_CPU] / 1e6,
+				blocked > 0 ? blocked : 0.0);
+		else
+			fprintf(stderr, " %10s %10s", "-", "-");
+		for (j = PROF_CSW; j < PROF_NCOUNT; j++)
+			if (prof_have[j])
+				fprintf(stderr, j == PROF_MIGR ? " %5lld" : " %7lld",
+					count[j]);
+			else
+				fprintf(stderr, j == PROF_MIGR ? " %5s" : " %7s", "-");
+		fprintf(stderr, "\n");
+	}
+	if (prof_fd < 0)
+		fprintf(stderr, "(%s, counted with getrusage)\n", prof_why);
+	else if (prof_user)
+		fprintf(stderr, "(user space only, as perf_event_paranoid asks)\n");
+}
+
 int
 unique(path)
 char *path;
@@ -188,6 +832,11 @@ char *path;
 
 	if (!uflg)
 		return 1;
+	if (path == NULL) {	/* start over, for the next -a variable */
+		while (n >= 0)
+			free(hist[n--]);
+		return 1;
+	}
 
 	if (++n >= hist_size) {
 		hist_size += 32;
@@ -277,7 +926,9 @@ struct addrinfo **result;
         hints.ai_flags = AI_ADDRCONFIG;
 	if (Dflg)
 		fprintf(stderr, "looking up %s\n", host);
+	prof_enter(PROF_RESOLVE);
         ret = getaddrinfo(host, NULL, &hints, result);
+	prof_leave();
         if (ret != 0) {
                 fprintf(stderr, "%s: getaddrinfo returned %s\n",
                         host, gai_strerror(ret));
@@ -326,8 +977,10 @@ struct addrinfo **result;
                 hints.ai_socktype = SOCK_STREAM; break;
         }
         hints.ai_flags = AI_ADDRCONFIG;
+	prof_enter(PROF_RESOLVE);
         ret = getaddrinfo(address, NULL, &hints, result);
-        if (ret != 0) {
+	prof_leave();
+        if (ret != 0 && !probe_quiet) {
                 fprintf(stderr, "%s: getaddrinfo returned %s\n",
                         address, gai_strerror(ret));
         }
@@ -336,11 +989,161 @@ struct addrinfo **result;
         return ret == 0;
 }
 
+/*
+ * Fast failure.  A server that is rebooting or gone usually says so:
+ * a TCP reset, an ICMP port or host unreachable from it or a router,
+ * or no route at all in our own table.  Those fail the probe at once
+ * instead of after the timeout, and probe_fail says which it was.
+ */
+
+static void
+fail_fast(sock, family, proto)
+/*
+ * Have the kernel report ICMP errors on sock even where it would
+ * treat them as transient and keep retrying (IP_RECVERR), and for
+ * TCP, give up on SYNs within the timeout, and in watch mode on
+ * unacknowledged data too
+ */
+     int sock, family, proto;
+{
+	int on = 1, n, ms = probe_ms();
+
+#ifdef IP_RECVERR
+	if (family == AF_INET6)
+		(void) setsockopt(sock, SOL_IPV6, IPV6_RECVERR, &on, sizeof(on));
+	else
+		(void) setsockopt(sock, SOL_IP, IP_RECVERR, &on, sizeof(on));
+#endif
+	if (proto != IPPROTO_TCP)
+		return;
+#ifdef TCP_SYNCNT
+	/* SYNs go out after 0, 1, 3, 7.. seconds, and connect fails at
+	   the next step after the last one */
+	for (n = 1; n < 127 && ((2L << n) - 1) * 1000 < ms; n++)
+		;
+	(void) setsockopt(sock, IPPROTO_TCP, TCP_SYNCNT, &n, sizeof(n));
+#endif
+#ifdef TCP_USER_TIMEOUT
+	/* watch mode keeps its connections, and a dead server should
+	   break them rather than leave calls to time out one by one */
+	if (interval) {
+		ms = timeout * 1000;
+		(void) setsockopt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT,
+				  &ms, sizeof(ms));
+	}
+#endif
+}
+
+static const char *
+sock_fail(sock, errp)
+/*
+ * Say why a probe on sock failed, from *errp, or the pending error on
+ * sock if that is 0.  An ICMP message queued by IP_RECVERR takes
+ * precedence, as it tells a router's unreachable apart from no route
+ * in our own table.  *errp is set to the error.
+ */
+     int sock, *errp;
+{
+	int err = *errp, icmp = 0;
+	socklen_t len = sizeof(err);
+#ifdef IP_RECVERR
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *ee;
+	char cbuf[512], from[INET6_ADDRSTRLEN];
+	struct sockaddr *sa;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0)
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP &&
+			      cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			      cm->cmsg_type == IPV6_RECVERR))
+				continue;
+			ee = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (ee->ee_origin != SO_EE_ORIGIN_ICMP &&
+			    ee->ee_origin != SO_EE_ORIGIN_ICMP6)
+				continue;
+			icmp = 1;
+			err = ee->ee_errno;
+			sa = SO_EE_OFFENDER(ee);
+			if ((Dflg || vflg) &&
+			    inet_ntop(sa->sa_family, sa->sa_family == AF_INET6 ?
+				      (void *)&((struct sockaddr_in6 *)sa)->sin6_addr :
+				      (void *)&((struct sockaddr_in *)sa)->sin_addr,
+				      from, sizeof(from)))
+				fprintf(stderr, "ICMP type %d code %d from %s\n",
+					ee->ee_type, ee->ee_code, from);
+		}
+#endif
+	if (err == 0 &&
+	    getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&err, &len) < 0)
+		err = errno;
+	*errp = err;
+	switch (err) {
+	case ECONNREFUSED:
+	case ECONNRESET:
+		return "refused";
+	case ENETUNREACH:
+	case EHOSTUNREACH:
+	case ENETDOWN:
+#ifdef EHOSTDOWN
+	case EHOSTDOWN:
+#endif
+		return icmp ? "unreachable" : "no route";
+	case EACCES:
+	case EPERM:
+		return "prohibited";	/* by a local route or firewall */
+	case ETIME:
+	case ETIMEDOUT:
+		return "timeout";
+	}
+	return "error";
+}
+
+static int
+probe_failed(sock, err)
+/*
+ * Set probe_fail from sock_fail, and return the error
+ */
+     int sock, err;
+{
+	probe_fail = sock_fail(sock, &err);
+	return err;
+}
+
+static void
+rpc_failed(client, stat)
+/*
+ * Set probe_fail after a call on client failed with stat
+ */
+     CLIENT *client;
+     enum clnt_stat stat;
+{
+	struct rpc_err err;
+	int sock = -1;
+
+	clnt_geterr(client, &err);
+#ifdef CLGET_FD
+	(void) clnt_control(client, CLGET_FD, (char *)&sock);
+#endif
+	if (stat == RPC_TIMEDOUT)
+		probe_fail = "timeout";
+	else if ((stat == RPC_CANTSEND || stat == RPC_CANTRECV) && sock >= 0)
+		(void) probe_failed(sock, err.re_errno);
+	else
+		probe_fail = "rpc";	/* the server said no */
+}
+
 /* portability note: Ultrix doesn't have clnt_create, so we wrap
    clntudp_create and clnttcp_create ourselves. */
 
 static int
-connected_socket(saddr, port, proto)
+connected_socket(hostname, saddr, port, proto)
+     const char *hostname;
      struct sockaddr_in *saddr;
      int port, proto;
 {
@@ -349,7 +1152,9 @@ connected_socket(saddr, port, proto)
         int flags;
         int socktype;
         char *protoname;
+        long start = TRACE_US();
 
+        TRACE3(connect__entry, hostname, port, proto);
         if (proto == IPPROTO_UDP) {
                 socktype = SOCK_DGRAM;
                 protoname = "UDP";
@@ -374,35 +1179,76 @@ connected_socket(saddr, port, proto)
         }
         flags = fcntl(sock, F_GETFL);
         fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        fail_fast(sock, saddr->sin_family, proto);
         {
-                int ret;
+                int ret, err = 0;
+                socklen_t errlen = sizeof(err);
+
                 ret = connect(sock, (struct sockaddr *) saddr, len);
                 if (ret != 0 && errno == EINPROGRESS) {
                         struct timeval tv;
                         fd_set fds;
 
                         FD_ZERO(&fds);
-                        tv.tv_sec = timeout;
-                        tv.tv_usec = 0;
+                        probe_tv(&tv);
 
                         while (1) {
                                 FD_SET(sock, &fds);
                                 ret = select(sock+1, NULL, &fds, NULL, &tv);
                                 if (ret == 0) {
                                         /* timeout */
-                                        errno = ETIME;
-                                        return -1;
-                                } else if (ret > 0)
+                                        err = ETIME;
+                                        break;
+                                } else if (ret > 0) {
+                                        /* connected, or reset or
+                                           unreachable */
+                                        if (getsockopt(sock, SOL_SOCKET, SO_ERROR,
+                                                       (char *)&err, &errlen) < 0)
+                                                err = errno;
                                         break;
+                                } else if (errno != EINTR) {
+                                        err = errno;
+                                        break;
+                                }
                         }
+                } else if (ret != 0)
+                        err = errno;	/* no route, or refused at once */
+                if (err) {
+                        err = probe_failed(sock, err);
+                        close(sock);
+                        errno = err;
+                        TRACE4(connect__return, hostname, -1, err,
+                               TRACE_US() - start);
+                        return -1;
                 }
         }
         fcntl(sock, F_SETFL, flags);
+        TRACE4(connect__return, hostname, sock, 0, TRACE_US() - start);
         return sock;
 }
 
 static CLIENT *
-create_udp_client(saddr, port, prog, vers)
+own_socket(client, sock)
+/*
+ * Let clnt_destroy close the socket we handed to the client, so that
+ * long running modes don't leak a descriptor per probe.
+ */
+     CLIENT *client;
+     int sock;
+{
+	if (client == NULL) {
+		close(sock);
+		return NULL;
+	}
+#ifdef CLSET_FD_CLOSE
+	clnt_control(client, CLSET_FD_CLOSE, NULL);
+#endif
+	return client;
+}
+
+static CLIENT *
+create_udp_client(hostname, saddr, port, prog, vers)
+     const char *hostname;
      struct sockaddr_in *saddr;
      int port, prog, vers;
 {
@@ -410,32 +1256,39 @@ create_udp_client(saddr, port, prog, vers)
         struct sockaddr_in saddr_copy;
 	int sock;
 
-        sock = connected_socket(saddr, port, IPPROTO_UDP);
+        sock = connected_socket(hostname, saddr, port, IPPROTO_UDP);
         if (sock == -1)
                 return NULL;
 
+        /* connected_socket has set the port, in network order */
         memcpy(&saddr_copy, saddr, sizeof(saddr_copy));
-        saddr_copy.sin_port = port;
-	return clntudp_create(&saddr_copy, prog, vers, interval, &sock);
+	/* the library doubles this on every retransmit: only the
+	   NULL ping, sent by udp_ping, keeps to the -r schedule */
+	interval.tv_sec = udp_sched[0] / 1000;
+	interval.tv_usec = udp_sched[0] % 1000 * 1000;
+	return own_socket(clntudp_create(&saddr_copy, prog, vers, interval, &sock),
+			  sock);
 }
 
 static CLIENT *
-create_tcp_client(saddr, port, prog, vers)
+create_tcp_client(hostname, saddr, port, prog, vers)
+     const char *hostname;
      struct sockaddr_in *saddr;
      int port, prog, vers;
 {
-	int sock = connected_socket(saddr, port, IPPROTO_TCP);
+	int sock = connected_socket(hostname, saddr, port, IPPROTO_TCP);
         if (sock == -1)
                 return NULL;
 
-	return clnttcp_create(saddr, prog, vers, &sock, 0, 0);
+	return own_socket(clnttcp_create(saddr, prog, vers, &sock, 0, 0), sock);
 }
 
 static int
-get_port_from_pmap(hostname, clntcreat, saddr, vers, proto, rpc_error_text)
+get_port_from_pmap(hostname, clntcreat, saddr, prog, vers, proto, rpc_error_text)
 	const char *hostname;
 	CLIENT *(*clntcreat)();
 	const struct sockaddr_in *saddr;
+	long prog;
 	int vers;
         int proto;
         char **rpc_error_text;
@@ -444,13 +1297,20 @@ get_port_from_pmap(hostname, clntcreat, saddr, vers, proto, rpc_error_text)
 	struct pmap pmap;
 	struct timeval tottimeout;
 	unsigned short port = 0;
+	enum clnt_stat stat;
+	long start = TRACE_US();
 
+	TRACE3(pmap__entry, hostname, prog, vers);
 	/*
 	 * Get socket to remote portmapper
 	 */
-	client = clntcreat(saddr, PMAPPORT, PMAPPROG, PMAPVERS);
+	client = clntcreat(hostname, saddr, PMAPPORT, PMAPPROG, PMAPVERS);
 	if (client == NULL) {
-                if (rpc_createerr.cf_stat == RPC_SUCCESS)
+		TRACE4(pmap__return, hostname, 0, rpc_createerr.cf_stat,
+		       TRACE_US() - start);
+                if (probe_quiet)
+                        ;
+                else if (rpc_createerr.cf_stat == RPC_SUCCESS)
                         fprintf(stderr, "%s portmapper: %s\n",
                                 hostname, strerror(errno));
                 else
@@ -461,22 +1321,24 @@ get_port_from_pmap(hostname, clntcreat, saddr, vers, proto, rpc_error_text)
 	/*
 	 * Query portmapper for port # of NFS server
 	 */
-	pmap.pm_prog = NFS_PROGRAM;
+	pmap.pm_prog = prog;
 	pmap.pm_vers = vers;
 	pmap.pm_prot = proto == 0 ? IPPROTO_UDP : proto;
 	pmap.pm_port = 0;
 
 	if (Dflg)
-		fprintf(stderr, "get port for NFS v%d (proto %ld) from portmapper\n",
-			vers, pmap.pm_prot);
+		fprintf(stderr, "get port for %s v%d (proto %ld) from portmapper\n",
+			prog == NFS_PROGRAM ? "NFS" : "mount", vers, pmap.pm_prot);
 
-	tottimeout.tv_sec = timeout;  /* total timeout */
-	tottimeout.tv_usec = 0;
+	probe_tv(&tottimeout);  /* total timeout */
 	/* on Linux xdr_pmap and xdr_u_short have mismatched type
 	   due to a header bug, so we add explicit casts */
-	if (clnt_call(client, PMAPPROC_GETPORT, (xdrproc_t)xdr_pmap,
-		      (caddr_t)&pmap, (xdrproc_t)xdr_u_short,
-		      (caddr_t)&port, tottimeout) != RPC_SUCCESS) {
+	stat = clnt_call(client, PMAPPROC_GETPORT, (xdrproc_t)xdr_pmap,
+			 (caddr_t)&pmap, (xdrproc_t)xdr_u_short,
+			 (caddr_t)&port, tottimeout);
+	TRACE4(pmap__return, hostname, port, stat, TRACE_US() - start);
+	if (stat != RPC_SUCCESS) {
+                rpc_failed(client, stat);
                 *rpc_error_text = clnt_sperror(client, hostname);
                 if (Dflg)
                         fprintf(stderr, "portmapper returned: %s\n", *rpc_error_text);
@@ -486,20 +1348,24 @@ get_port_from_pmap(hostname, clntcreat, saddr, vers, proto, rpc_error_text)
 	clnt_destroy(client);
 
 	if (port == 0) {
-		fprintf(stderr, "%s: NFS server not registered\n", hostname);
+		if (!probe_quiet)
+			fprintf(stderr, "%s: %s not registered\n", hostname,
+			prog == NFS_PROGRAM ? "NFS server" : "mount daemon");
 		return 0;
 	}
 	return port;
 }
 
-static int
-chknfsmntproto(hostname, proto, mount)
+static CLIENT *
+nfs_client(hostname, proto, mount)
+/*
+ * Look up the NFS port and return a client connected to it, or NULL
+ */
      const char *hostname;
      int proto;
      const struct m_mlist *mount;
 {
-	CLIENT *client;
-	struct timeval tottimeout;
+	CLIENT *client = NULL;
 	unsigned short port = 0;
         struct addrinfo *rp;
         char *rpc_error_text = NULL;
@@ -514,6 +1380,7 @@ chknfsmntproto(hostname, proto, mount)
                         port = get_port_from_pmap(hostname,
                                                   create_tcp_client,
                                                   (struct sockaddr_in *)rp->ai_addr,
+                                                  NFS_PROGRAM,
                                                   mount->nfs_version,
                                                   proto,
                                                   &rpc_error_text);
@@ -530,13 +1397,14 @@ chknfsmntproto(hostname, proto, mount)
                         */
                         struct addrinfo *hostaddr;
                         if (translate_hostname(hostname, IPPROTO_TCP, &hostaddr) == 0)
-                                return 0;
+                                return NULL;
                         rp = hostaddr;
                         while (rp) {
                                 /* always use TCP for portmap queries */
                                 port = get_port_from_pmap(hostname,
                                                           create_tcp_client,
                                                           (struct sockaddr_in *)rp->ai_addr,
+                                                          NFS_PROGRAM,
                                                           mount->nfs_version,
                                                           mount->proto,
                                                           &rpc_error_text);
@@ -548,9 +1416,9 @@ chknfsmntproto(hostname, proto, mount)
                                 freeaddrinfo(hostaddr);
                 }
                 if (port == 0) {
-                        if (rpc_error_text)
+                        if (rpc_error_text && !probe_quiet)
                                 fprintf(stderr, "%s\n", rpc_error_text);
-                        return 0;
+                        return NULL;
                 }
                 if (Dflg)
                         fprintf(stderr, "portmapper returned port %d\n", port);
@@ -562,61 +1430,594 @@ chknfsmntproto(hostname, proto, mount)
 	 */
         rp = mount->mountaddr;
         while (rp) {
-                client = clntcreat((struct sockaddr_in *)rp->ai_addr,
-                                   port, NFS_PROGRAM, nfs_version);
+                client = clntcreat(hostname, (struct sockaddr_in *)rp->ai_addr,
+                                   port, NFS_PROGRAM,
+                                   mount->nfs_version >= 2 ? mount->nfs_version : nfs_version);
                 if (client)
                         break;
                 rp = rp->ai_next;
 	}
         if (client == NULL) {
-                if (rpc_createerr.cf_stat == RPC_SUCCESS)
+                if (probe_quiet)
+                        ;
+                else if (rpc_createerr.cf_stat == RPC_SUCCESS)
                         perror(hostname);
                 else
                         clnt_pcreateerror(hostname);
-		return 0;
+		return NULL;
         }
-	/*
-	 * Ping NFS server
-	 */
-	tottimeout.tv_sec = timeout;
-	tottimeout.tv_usec = 0;
-	/* on Linux xdr_void has mismatched type due to a header bug,
-	   so we add explicit casts */
-	if (clnt_call(client, NULLPROC, (xdrproc_t)xdr_void, NULL, (xdrproc_t)xdr_void, NULL,
-		      tottimeout) != RPC_SUCCESS) {
-		clnt_perror(client, hostname);
-		clnt_destroy(client);
-		return 0;
-	}
-	clnt_destroy(client);
-	return 1;
+	return client;
 }
 
-int
-chknfsmnt(mlist)
+static int
+udp_socket(client)
 /*
- * Ping the NFS server indicated by the given mnt entry
+ * Return the client's socket if it is a datagram socket, else -1
  */
-struct m_mlist *mlist;
+     CLIENT *client;
 {
-	char *s;
-	struct m_mlist *mlist2;
-	int len;
-	static char p[MAXPATHLEN];
+#ifdef CLGET_FD
+	int sock, type;
+	socklen_t len = sizeof(type);
 
-	if (Dflg)
-		fprintf(stderr, "chknfsmnt(%s)\n", mlist->mlist_fsname);
+	if (clnt_control(client, CLGET_FD, (char *)&sock) &&
+	    getsockopt(sock, SOL_SOCKET, SO_TYPE, (char *)&type, &len) == 0 &&
+	    type == SOCK_DGRAM)
+		return sock;
+#endif
+	return -1;
+}
 
-	if (mlist->mlist_checked) /* if already checked this mount point */
-		return (mlist->mlist_checked);
+static u_int
+rpc_encode(buf, size, xid, prog, vers, proc, xargs, args)
+/*
+ * Encode a call with null credentials in buf.  Return its length, or
+ * 0 if it doesn't fit
+ */
+     char *buf;
+     u_int size;
+     u_int32_t xid;
+     u_long prog, vers, proc;
+     xdrproc_t xargs;
+     void *args;
+{
+	struct rpc_msg msg;
+	XDR xdrs;
+	u_int len = 0;
 
-	if (mlist->mlist_pid)
-		return check_automount(mlist);
+	memset(&msg, 0, sizeof(msg));
+	msg.rm_xid = xid;
+	msg.rm_direction = CALL;
+	msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+	msg.rm_call.cb_prog = prog;
+	msg.rm_call.cb_vers = vers;
+	msg.rm_call.cb_proc = proc;
+	msg.rm_call.cb_cred = _null_auth;
+	msg.rm_call.cb_verf = _null_auth;
+	xdrmem_create(&xdrs, buf, size, XDR_ENCODE);
+	if (xdr_callmsg(&xdrs, &msg) && (*xargs)(&xdrs, args))
+		len = XDR_GETPOS(&xdrs);
+	XDR_DESTROY(&xdrs);
+	return len;
+}
 
-	/*
+static enum clnt_stat
+rpc_decode(buf, len, xres, res)
+/*
+ * Decode the reply of len bytes in buf, the results into res
+ */
+     char *buf;
+     u_int len;
+     xdrproc_t xres;
+     void *res;
+{
+	struct rpc_msg msg;
+	struct rpc_err err;
+	XDR xdrs;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.acpted_rply.ar_results.where = res;
+	msg.acpted_rply.ar_results.proc = xres;
+	xdrmem_create(&xdrs, buf, len, XDR_DECODE);
+	if (!xdr_replymsg(&xdrs, &msg))
+		err.re_status = RPC_CANTDECODERES;
+	else
+		_seterr_reply(&msg, &err);
+	XDR_DESTROY(&xdrs);
+	return err.re_status;
+}
+
+static enum clnt_stat
+udp_ping(client, sock, hostname)
+/*
+ * NULLPROC over UDP on the client's (connected) socket, sending the
+ * datagram again on the -r schedule rather than the RPC library's,
+ * so we know how many went out and how many answers came back.  The
+ * same xid is used throughout, so a late answer to any copy counts.
+ */
+     CLIENT *client;
+     int sock;
+     const char *hostname;
+{
+	char out[128], in[512];
+	u_int outlen;
+	u_int32_t xid, vers = nfs_version;
+	struct timeval tv;
+	fd_set fds;
+	long t, next, deadline, start = TRACE_US();
+	int n, step = 0, sent = 0, replies = 0, error = 0;
+	enum clnt_stat stat = RPC_TIMEDOUT;
+
+#ifdef CLGET_VERS
+	clnt_control(client, CLGET_VERS, (char *)&vers);
+#endif
+	xid = getpid() ^ now_us();
+	if ((outlen = rpc_encode(out, sizeof(out), xid, NFS_PROGRAM, vers,
+				 NULLPROC, (xdrproc_t)xdr_void, NULL)) == 0) {
+		fprintf(stderr, "%s: can't encode NULL call\n", hostname);
+		return RPC_CANTENCODEARGS;
+	}
+
+	next = now_ms();
+	deadline = next + probe_ms();
+	while ((t = now_ms()) < deadline) {
+		if (t >= next) {
+			if (send(sock, out, outlen, 0) < 0) {
+				error = probe_failed(sock, errno);
+				stat = RPC_CANTSEND;
+				break;
+			}
+			sent++;
+			next = t + udp_sched[step];
+			if (step < udp_nsched - 1)
+				step++;
+		}
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		t = (next < deadline ? next : deadline) - t;
+		tv.tv_sec = t / 1000;
+		tv.tv_usec = t % 1000 * 1000;
+		n = select(sock + 1, &fds, NULL, NULL, &tv);
+		if (n <= 0)
+			continue;
+		if ((n = recv(sock, in, sizeof(in), 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			error = probe_failed(sock, errno);	/* from ICMP */
+			stat = RPC_CANTRECV;
+			break;
+		}
+		if (n < 4 || ntohl(*(u_int32_t *)in) != xid)
+			continue;
+		replies++;
+		stat = rpc_decode(in, n, (xdrproc_t)xdr_void, NULL);
+		/* count answers to earlier copies that are already here */
+		while (recv(sock, in, sizeof(in), MSG_DONTWAIT) >= 4 &&
+		       ntohl(*(u_int32_t *)in) == xid)
+			replies++;
+		break;
+	}
+
+	TRACE4(udp__return, hostname, sent, replies, TRACE_US() - start);
+	if (Dflg || (vflg && (sent > 1 || replies > 1)))
+		fprintf(stderr, "%s: UDP %d sent, %d replies\n",
+			hostname, sent, replies);
+	if (probe_quiet)
+		;
+	else if (stat == RPC_CANTRECV || stat == RPC_CANTSEND)
+		fprintf(stderr, "%s: %s (%s)\n", hostname, strerror(error),
+			probe_fail);
+	else if (stat == RPC_TIMEDOUT)
+		fprintf(stderr, "%s: no reply to %d datagrams\n",
+			hostname, sent);
+	else if (stat != RPC_SUCCESS)
+		fprintf(stderr, "%s: %s\n", hostname, clnt_sperrno(stat));
+	if (stat == RPC_TIMEDOUT)
+		probe_fail = "timeout";
+	else if (stat != RPC_SUCCESS && stat != RPC_CANTRECV &&
+		 stat != RPC_CANTSEND)
+		probe_fail = "rpc";
+	return stat;
+}
+
+static int
+nfs_ping(client, hostname, rtt)
+/*
+ * Send NULLPROC on an established client and store the round trip
+ * time in *rtt (ms).  Return 1 if ok, 0 if error
+ */
+     CLIENT *client;
+     const char *hostname;
+     long *rtt;
+{
+	struct timeval tottimeout;
+	enum clnt_stat stat;
+	long start = now_us();
+	int sock;
+
+	probe_tv(&tottimeout);
+	TRACE1(null__entry, hostname);
+	if ((sock = udp_socket(client)) >= 0)
+		stat = udp_ping(client, sock, hostname);
+	else
+		/* on Linux xdr_void has mismatched type due to a header
+		   bug, so we add explicit casts */
+		stat = clnt_call(client, NULLPROC, (xdrproc_t)xdr_void, NULL,
+				 (xdrproc_t)xdr_void, NULL, tottimeout);
+	TRACE3(null__return, hostname, stat, now_us() - start);
+	if (stat != RPC_SUCCESS) {
+		if (sock < 0) {
+			if (!probe_quiet)
+				clnt_perror(client, hostname);
+			rpc_failed(client, stat);
+		}
+		return 0;
+	}
+	*rtt = (now_us() - start) / 1000;
+	return 1;
+}
+
+/*
+ * Real operation probe (-R).  NULLPROC is answered by the RPC layer
+ * even when the file system behind it is wedged.  So after the ping,
+ * ask for something that has to touch the export: FSINFO on the
+ * export root for v2/v3 (the file handle comes from the mount
+ * daemon), PUTROOTFH+GETATTR in a COMPOUND for v4.  Any answer from
+ * the NFS layer counts, even an error status; only no answer means
+ * the server is stalled.  A mount daemon that doesn't answer is stuck
+ * on the same backend, so that is a stall too.  One that refuses us
+ * (an unprivileged port, usually) leaves us with the ping only, and
+ * the probe says so.  With -S the handle is kept in statedir/<host>.fh
+ * so later runs don't go through the mount daemon at all.
+ */
+
+#ifndef MOUNTPROG
+# define MOUNTPROG	100005L
+#endif
+#define MOUNTVERS3	3
+#define MOUNTPROC3_MNT	1
+#define MOUNTPROC3_UMNT	3
+#define MNT3ERR_PERM	1
+#define MNT3ERR_ACCES	13
+#define NFS3ERR_STALE	70
+#define NFS3ERR_BADHANDLE 10001
+#define NFSPROC3_FSINFO	19
+#define NFSPROC4_COMPOUND 1
+#define OP4_GETATTR	9
+#define OP4_PUTROOTFH	24
+
+static bool_t
+xdr_dirpath(xdrs, path)
+	XDR *xdrs;
+	char **path;
+{
+	return xdr_string(xdrs, path, MAXPATHLEN);
+}
+
+struct mntres3 {
+	u_int status;
+	struct fhandle3 *fh;
+};
+
+static bool_t
+xdr_mntres3(xdrs, res)
+/*
+ * mountres3, keeping only the status and the file handle
+ */
+	XDR *xdrs;
+	struct mntres3 *res;
+{
+	char *data = res->fh->data;
+
+	if (!xdr_u_int(xdrs, &res->status))
+		return FALSE;
+	if (res->status != 0) {
+		res->fh->len = 0;
+		return TRUE;
+	}
+	return xdr_bytes(xdrs, &data, &res->fh->len, FHSIZE3);
+}
+
+static bool_t
+xdr_fh3(xdrs, fh)
+	XDR *xdrs;
+	struct fhandle3 *fh;
+{
+	char *data = fh->data;
+
+	return xdr_bytes(xdrs, &data, &fh->len, FHSIZE3);
+}
+
+static bool_t
+xdr_compound4(xdrs, arg)
+/*
+ * COMPOUND4args { tag "", minorversion 0, PUTROOTFH, GETATTR(type) }
+ */
+	XDR *xdrs;
+	void *arg;
+{
+	u_int zero = 0, nops = 2, op, bitmaplen = 1, word0 = 1 << 1;
+
+	op = OP4_PUTROOTFH;
+	if (!xdr_u_int(xdrs, &zero) || !xdr_u_int(xdrs, &zero) ||
+	    !xdr_u_int(xdrs, &nops) || !xdr_u_int(xdrs, &op))
+		return FALSE;
+	op = OP4_GETATTR;
+	return xdr_u_int(xdrs, &op) && xdr_u_int(xdrs, &bitmaplen) &&
+		xdr_u_int(xdrs, &word0);
+}
+
+static bool_t
+xdr_status(xdrs, status)
+/*
+ * Just the leading status word of a reply
+ */
+	XDR *xdrs;
+	u_int *status;
+{
+	return xdr_u_int(xdrs, status);
+}
+
+static int
+fh_read(host, path, fh)
+/*
+ * Get the handle of path on host kept by an earlier run with -S.
+ * Return 1 if there is one
+ */
+     const char *host, *path;
+     struct fhandle3 *fh;
+{
+	char line[2 * FHSIZE3 + MAXPATHLEN + 2], *file, *sp;
+	FILE *fp;
+	u_int i, n, byte;
+	int ok;
+
+	if (statedir == NULL || (file = state_file(host, ".fh")) == NULL ||
+	    (fp = fopen(file, "r")) == NULL)
+		return 0;
+	ok = fgets(line, sizeof(line), fp) != NULL;
+	fclose(fp);
+	if (!ok || (sp = strchr(line, ' ')) == NULL)
+		return 0;
+	line[strcspn(line, "\n")] = '\0';
+	n = (sp - line) / 2;
+	if ((sp - line) % 2 || n == 0 || n > FHSIZE3 || strcmp(sp + 1, path) != 0)
+		return 0;
+	for (i = 0; i < n; i++) {
+		if (!isxdigit((unsigned char)line[2 * i]) ||
+		    !isxdigit((unsigned char)line[2 * i + 1]) ||
+		    sscanf(line + 2 * i, "%2x", &byte) != 1)
+			return 0;
+		fh->data[i] = byte;
+	}
+	fh->len = n;
+	if (Dflg)
+		fprintf(stderr, "%s: root file handle from %s\n", host, file);
+	return 1;
+}
+
+static void
+fh_write(host, path, fh)
+/*
+ * Keep the handle of path on host in statedir/<host>.fh, as
+ * "<hex handle> <path>"
+ */
+     const char *host, *path;
+     const struct fhandle3 *fh;
+{
+	char line[2 * FHSIZE3 + MAXPATHLEN + 2];
+	u_int i, n = 0;
+
+	if (statedir == NULL || strlen(path) >= MAXPATHLEN || strchr(path, '\n'))
+		return;
+	for (i = 0; i < fh->len; i++)
+		n += sprintf(line + n, "%02x", (unsigned char)fh->data[i]);
+	sprintf(line + n, " %s\n", path);
+	(void) state_write(host, ".fh", line);
+}
+
+static int
+root_fh(hostname, mount)
+/*
+ * Get file handle of the export root from the mount daemon, once.
+ * Return 1 if ok, -1 if the mount daemon refused us, 0 if it didn't
+ * answer
+ */
+     const char *hostname;
+     struct m_mlist *mount;
+{
+	CLIENT *client = NULL;
+	struct timeval tottimeout;
+	struct addrinfo *rp;
+	struct mntres3 res;
+	enum clnt_stat stat;
+	char *rpc_error_text = NULL;
+	char *path;
+	int port = 0, ret;
+
+	if (mount->mlist_fh.len)
+		return 1;
+	if ((path = strchr(mount->mlist_fsname, ':')) == NULL)
+		return -1;	/* nothing to ask for */
+	path++;
+	if (fh_read(hostname, path, &mount->mlist_fh))
+		return 1;
+	for (rp = mount->mountaddr; rp && !client; rp = rp->ai_next) {
+		port = get_port_from_pmap(hostname, create_tcp_client,
+					  (struct sockaddr_in *)rp->ai_addr,
+					  MOUNTPROG, MOUNTVERS3, IPPROTO_TCP,
+					  &rpc_error_text);
+		if (port)
+			client = create_tcp_client(hostname,
+						   (struct sockaddr_in *)rp->ai_addr,
+						   port, MOUNTPROG, MOUNTVERS3);
+	}
+	if (client == NULL) {
+		if (rpc_error_text && vflg && !probe_quiet)
+			fprintf(stderr, "%s\n", rpc_error_text);
+		return 0;
+	}
+	client->cl_auth = authunix_create_default();
+	probe_tv(&tottimeout);
+	res.fh = &mount->mlist_fh;
+	stat = clnt_call(client, MOUNTPROC3_MNT, (xdrproc_t)xdr_dirpath,
+			 (caddr_t)&path, (xdrproc_t)xdr_mntres3,
+			 (caddr_t)&res, tottimeout);
+	if (stat == RPC_AUTHERROR || (stat == RPC_SUCCESS &&
+	    (res.status == MNT3ERR_PERM || res.status == MNT3ERR_ACCES))) {
+		if (vflg && !probe_quiet)
+			fprintf(stderr, "%s: mount daemon refused %s\n",
+				hostname, path);
+		mount->mlist_fh.len = 0;
+		ret = -1;
+	} else if (stat != RPC_SUCCESS) {
+		if (vflg && !probe_quiet)
+			clnt_perror(client, hostname);
+		rpc_failed(client, stat);
+		mount->mlist_fh.len = 0;
+		ret = 0;
+	} else if (res.status != 0) {
+		if (vflg && !probe_quiet)
+			fprintf(stderr, "%s: mount daemon: error %u for %s\n",
+				hostname, res.status, path);
+		ret = 0;
+	} else {
+		/* we don't really mount it, so take it off the server's list */
+		(void) clnt_call(client, MOUNTPROC3_UMNT, (xdrproc_t)xdr_dirpath,
+				 (caddr_t)&path, (xdrproc_t)xdr_void, NULL,
+				 tottimeout);
+		fh_write(hostname, path, &mount->mlist_fh);
+		ret = 1;
+	}
+	auth_destroy(client->cl_auth);
+	clnt_destroy(client);
+	return ret;
+}
+
+static int
+nfs_op(client, hostname, mount)
+/*
+ * Do a cheap real operation on an established client, and store its
+ * round trip time in mount->mlist_oprtt.  Return 1 if ok, 0 if error,
+ * 2 if it could not be tried and the server only had the ping, with
+ * mlist_oprtt -1
+ */
+     CLIENT *client;
+     const char *hostname;
+     struct m_mlist *mount;
+{
+	struct timeval tottimeout;
+	enum clnt_stat stat;
+	AUTH *auth;
+	u_int status = 0;
+	long start;
+	char *opname;
+
+	if (mount->nfs_version == 2) {
+		/* FSINFO is version 3 only, and a version 1 mount
+		   handle isn't worth the extra round trips */
+		if (vflg && !probe_quiet)
+			fprintf(stderr, "%s: NFS version 2, skipping FSINFO\n",
+				hostname);
+		mount->mlist_oprtt = -1;
+		return 2;
+	}
+	if (mount->nfs_version != 4)
+		switch (root_fh(hostname, mount)) {
+		case 0:
+			if (!probe_quiet)
+				fprintf(stderr, "%s: MNT: no answer from the mount daemon\n",
+					hostname);
+			return 0;
+		case -1:
+			/* the NFS side answered, so don't call it
+			   dead for lack of a file handle */
+			if (vflg && !probe_quiet)
+				fprintf(stderr, "%s: no root file handle, skipping FSINFO\n",
+					hostname);
+			mount->mlist_oprtt = -1;
+			return 2;
+		}
+	auth = client->cl_auth;
+	client->cl_auth = authunix_create_default();
+	probe_tv(&tottimeout);
+	start = now_ms();
+	if (mount->nfs_version == 4) {
+		opname = "COMPOUND";
+		stat = clnt_call(client, NFSPROC4_COMPOUND,
+				 (xdrproc_t)xdr_compound4, NULL,
+				 (xdrproc_t)xdr_status, (caddr_t)&status,
+				 tottimeout);
+	} else {
+		opname = "FSINFO";
+		stat = clnt_call(client, NFSPROC3_FSINFO,
+				 (xdrproc_t)xdr_fh3, (caddr_t)&mount->mlist_fh,
+				 (xdrproc_t)xdr_status, (caddr_t)&status,
+				 tottimeout);
+	}
+	mount->mlist_oprtt = now_ms() - start;
+	auth_destroy(client->cl_auth);
+	client->cl_auth = auth;
+	/* a server that says it can't do the operation has still
+	   answered, which is all we want to know */
+	if (stat != RPC_SUCCESS && stat != RPC_AUTHERROR &&
+	    stat != RPC_PROCUNAVAIL && stat != RPC_PROGVERSMISMATCH) {
+		if (!probe_quiet)
+			fprintf(stderr, "%s: %s: %s\n", hostname, opname,
+				clnt_sperrno(stat));
+		return 0;
+	}
+	if (Dflg)
+		fprintf(stderr, "%s: %s status %u in %ldms\n", hostname, opname,
+			status, mount->mlist_oprtt);
+	if (mount->nfs_version != 4 &&
+	    (status == NFS3ERR_STALE || status == NFS3ERR_BADHANDLE)) {
+		/* exported anew: ask the mount daemon next time */
+		mount->mlist_fh.len = 0;
+		if (statedir && state_file(hostname, ".fh") != NULL)
+			(void) unlink(state_file(hostname, ".fh"));
+	}
+	return 1;
+}
+
+static int
+chknfsmntproto(hostname, proto, mount, rtt)
+     const char *hostname;
+     int proto;
+     struct m_mlist *mount;
+     long *rtt;
+{
+	CLIENT *client;
+	int ok;
+
+	if ((client = nfs_client(hostname, proto, mount)) == NULL)
+		return 0;
+	/*
+	 * Ping NFS server
+	 */
+	ok = nfs_ping(client, hostname, rtt);
+	if (ok && Rflg)
+		ok = nfs_op(client, hostname, mount) != 0;
+	clnt_destroy(client);
+	return ok;
+}
+
+static void
+server_name(fsname, p, size)
+/*
+ * Copy the server part of fsname ("host:/export") to p
+ */
+     const char *fsname;
+     char *p;
+     int size;
+{
+	char *s;
+
+	/*
 	 * Save path to working storage and strip colon
 	 */
-	(void) strncpy(p, mlist->mlist_fsname, sizeof(p)-1);
+	(void) strncpy(p, fsname, size-1);
+	p[size-1] = '\0';
         if (p[0] == '[') {
                 s = strchr(p, ']');
                 assert(s);
@@ -624,499 +2025,5103 @@ struct m_mlist *mlist;
                 s[1] = 0;
         } else if  ((s = strchr(p, ':')) != NULL)
 		*s = '\0';
-	len = strlen(p);
+}
+
+static int
+mount_addr(host, mlist)
+/*
+ * Resolve the address of the server of mlist the first time it is
+ * probed: the mountaddr option if the mount had one, else host.
+ * Return 1 if ok, 0 if error
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	if (mlist->mountaddr)
+		return 1;
+	if (mlist->mlist_addr &&
+	    translate_address(mlist->mlist_addr, mlist->proto, &mlist->mountaddr))
+		return 1;
+	return translate_hostname(host, mlist->proto, &mlist->mountaddr);
+}
+
+static int
+_probe_server(host, mlist)
+/*
+ * Ping the NFS server host serving mlist, trying TCP then UDP unless
+ * the mount says which.  Return 1 if ok, 0 if error
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	if (!rpc_load()) {
+		probe_fail = "no RPC library";
+		return 0;
+	}
+	if (!mount_addr(host, mlist)) {
+		probe_fail = "unknown host";
+		return 0;
+	}
+
+	if (mlist->proto)
+		return chknfsmntproto(host, mlist->proto, mlist, &mlist->mlist_rtt);
+	return chknfsmntproto(host, IPPROTO_TCP, mlist, &mlist->mlist_rtt) ||
+		chknfsmntproto(host, IPPROTO_UDP, mlist, &mlist->mlist_rtt);
+}
+
+/*
+ * Record and replay.  With -c, the outcome of every server probe is
+ * appended to a file as "host ok rtt oprtt".  With -p, probes are
+ * answered from such a file instead of the network, the last line
+ * for a host winning, and hosts not in it are dead.  Together with
+ * -M this runs big synthetic mount tables without any NFS server.
+ */
+
+struct r_result {
+	struct r_result *r_next;
+	char *r_host;
+	int r_ok;
+	long r_rtt, r_oprtt;
+};
+static struct r_result *replayed;
+static struct r_result *probed;	/* outcomes so far, across -n namespaces */
+
+static void
+r_add(list, host, ok, rtt, oprtt)
+     struct r_result **list;
+     const char *host;
+     int ok;
+     long rtt, oprtt;
+{
+	struct r_result *r = (struct r_result *)xalloc(sizeof(*r));
+
+	r->r_host = xalloc(strlen(host) + 1);
+	strcpy(r->r_host, host);
+	r->r_ok = ok;
+	r->r_rtt = rtt;
+	r->r_oprtt = oprtt;
+	r->r_next = *list;
+	*list = r;
+}
+
+static struct r_result *
+r_find(list, host)
+     struct r_result *list;
+     const char *host;
+{
+	for (; list != NULL; list = list->r_next)
+		if (strcmp(list->r_host, host) == 0)
+			return list;
+	return NULL;
+}
+
+static void
+replay_load()
+{
+	FILE *fp;
+	char line[MAXPATHLEN + 64], host[MAXPATHLEN];
+	int ok;
+	long rtt, oprtt;
+
+	if ((fp = fopen(replayfile, "r")) == NULL) {
+		perror(replayfile);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%1023s %d %ld %ld", host, &ok, &rtt, &oprtt) == 4)
+			r_add(&replayed, host, ok, rtt, oprtt);
+	}
+	(void) fclose(fp);
+}
+
+static int
+replay(host, mlist)
+     const char *host;
+     struct m_mlist *mlist;
+{
+	static int loaded;
+	struct r_result *r;
+
+	if (!loaded++)
+		replay_load();
+	if ((r = r_find(replayed, host)) != NULL) {
+		mlist->mlist_rtt = r->r_rtt;
+		mlist->mlist_oprtt = r->r_oprtt;
+		if (!r->r_ok)
+			fprintf(stderr, "%s: dead in %s\n", host, replayfile);
+		return r->r_ok;
+	}
+	fprintf(stderr, "%s: not in %s\n", host, replayfile);
+	return 0;
+}
+
+static void
+record(host, ok, mlist)
+     const char *host;
+     int ok;
+     struct m_mlist *mlist;
+{
+	static FILE *fp;
+
+	if (fp == NULL && (fp = fopen(recordfile, "a")) == NULL) {
+		perror(recordfile);
+		recordfile = NULL;
+		return;
+	}
+	fprintf(fp, "%s %d %ld %ld\n", host, ok, mlist->mlist_rtt,
+		mlist->mlist_oprtt);
+	(void) fflush(fp);
+}
+
+static int
+probe_server(host, mlist)
+/*
+ * Probe for real, or from the -p file, and record the outcome for -c.
+ * A server is only probed once, even if it is in several mount tables.
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	struct r_result *r;
+	int ok;
+
+	if ((r = r_find(probed, host)) != NULL) {
+		mlist->mlist_rtt = r->r_rtt;
+		mlist->mlist_oprtt = r->r_oprtt;
+		return r->r_ok;
+	}
+	if (replayfile)
+		ok = replay(host, mlist);
+	else {
+		ok = _probe_server(host, mlist);
+		if (recordfile)
+			record(host, ok, mlist);
+	}
+	if (ok || !sliced(probe_fail))
+		r_add(&probed, host, ok, mlist->mlist_rtt, mlist->mlist_oprtt);
+	return ok;
+}
+
+/*
+ * Circuit breaker.  With -S, a server which fails a probe is
+ * remembered in statedir/<server> as "failures until".  Until that
+ * time has passed, every run treats the server as dead without
+ * touching the network.  After that, one run (whoever gets the lock
+ * on statedir/<server>.lock) re-probes the server in a background
+ * process, while it and everybody else still treat it as dead.  A
+ * failed re-probe doubles the wait, a successful one removes the
+ * state file so the server is probed normally again.
+ */
+
+#define BREAKER_MIN	10	/* seconds presumed dead after first failure */
+#define BREAKER_MAX	600	/* upper limit of backoff */
+
+static int probe_publish();
+
+static pid_t
+background()
+/*
+ * Fork a child which is off the caller's stdout, so `cknfs ...` in a
+ * shell doesn't wait for it.  Return like fork()
+ */
+{
+	pid_t pid;
+	int fd;
+
+	(void) fflush(stdout);
+	(void) fflush(stderr);
+	if ((pid = fork()) != 0)
+		return pid;
+	(void) setsid();
+	if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+		dup2(fd, 0);
+		dup2(fd, 1);
+		if (!Dflg)
+			dup2(fd, 2);
+		if (fd > 2)
+			close(fd);
+	}
+	return 0;
+}
+
+static char *
+state_file(host, suffix)
+/*
+ * Return the name of statedir/<host><suffix>, or NULL with errno set
+ * if it is too long, rather than a truncated name of some other file
+ */
+     const char *host, *suffix;
+{
+	static char path[MAXPATHLEN];
+	int n;
+
+	n = snprintf(path, sizeof(path), "%s/%s%s", statedir, host, suffix);
+	if (n < 0 || n >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	return path;
+}
+
+static int
+state_write(host, suffix, line)
+/*
+ * Atomically replace statedir/<host><suffix> with line
+ */
+     const char *host, *suffix, *line;
+{
+	char tmp[MAXPATHLEN], *file;
+	FILE *fp;
+
+	if ((file = state_file(host, suffix)) == NULL) {
+		if (vflg)
+			perror(host);
+		return 0;
+	}
+	if ((fp = tmp_open(file, tmp, sizeof(tmp))) == NULL) {
+		if (vflg)
+			perror(errno == ENAMETOOLONG ? file : tmp);
+		return 0;
+	}
+	fputs(line, fp);
+	if (fclose(fp) != 0 || rename(tmp, state_file(host, suffix)) != 0) {
+		if (vflg)
+			perror(state_file(host, suffix));
+		(void) unlink(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+breaker_read(host, until)
+/*
+ * Return number of consecutive failures recorded for host, 0 if none
+ */
+     const char *host;
+     time_t *until;
+{
+	FILE *fp;
+	int fails = 0;
+	long t = 0;
+	char *file;
+
+	if ((file = state_file(host, "")) == NULL ||
+	    (fp = fopen(file, "r")) == NULL)
+		return 0;
+	if (fscanf(fp, "%d %ld", &fails, &t) != 2)
+		fails = 0;
+	fclose(fp);
+	*until = t;
+	return fails;
+}
+
+static void
+breaker_record(host, ok)
+     const char *host;
+     int ok;
+{
+	time_t until;
+	int fails, n;
+	long backoff;
+	char line[64], *file;
+
+	if (ok) {
+		if ((file = state_file(host, "")) != NULL &&
+		    unlink(file) == 0 && vflg)
+			fprintf(stderr, "%s: breaker closed\n", host);
+		return;
+	}
+	fails = breaker_read(host, &until) + 1;
+	for (backoff = BREAKER_MIN, n = 1; n < fails && backoff < BREAKER_MAX; n++)
+		backoff *= 2;
+	if (backoff > BREAKER_MAX)
+		backoff = BREAKER_MAX;
+
+	snprintf(line, sizeof(line), "%d %ld\n", fails, (long)time(NULL) + backoff);
+	if (!state_write(host, "", line))
+		return;
+	if (vflg)
+		fprintf(stderr, "%s: presumed dead for %lds\n", host, backoff);
+}
+
+static int
+state_lock(host)
+/*
+ * Open statedir/<host>.lock to flock it, or return -1.  Everybody
+ * using the directory has to be able to open it: it is created
+ * writable by all, whatever the umask, and one made by someone else
+ * with a narrower mode is opened for reading, which is all flock
+ * needs.  A symbolic link is refused
+ */
+     const char *host;
+{
+	char *file;
+	int fd;
+
+	if ((file = state_file(host, ".lock")) == NULL) {
+		if (vflg)
+			perror(host);
+		return -1;
+	}
+	if ((fd = open(file, O_RDWR|O_CREAT|O_EXCL|O_NOFOLLOW, 0666)) >= 0) {
+		(void) fchmod(fd, 0666);
+		return fd;
+	}
+	if (errno == EEXIST &&
+	    (fd = open(file, O_RDWR|O_NOFOLLOW)) < 0 && errno == EACCES)
+		fd = open(file, O_RDONLY|O_NOFOLLOW);
+	if (fd < 0 && vflg)
+		perror(file);
+	return fd;
+}
+
+static int
+breaker_open(host, mlist)
+/*
+ * Return 1 if host should be treated as dead without probing it
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	time_t until;
+	int fd;
+	pid_t pid;
+
+	if (breaker_read(host, &until) == 0)
+		return 0;
+	if (time(NULL) < until) {
+		if (vflg)
+			fprintf(stderr, "%s: presumed dead, breaker open\n", host);
+		return 1;
+	}
+
+	/*
+	 * Backoff has expired.  Let exactly one process re-probe.
+	 */
+	if ((fd = state_lock(host)) < 0)
+		return 0;
+	if (flock(fd, LOCK_EX|LOCK_NB) < 0) {
+		close(fd);
+		if (vflg)
+			fprintf(stderr, "%s: presumed dead, re-probe in progress\n",
+				host);
+		return 1;
+	}
+	if ((pid = background()) < 0) {
+		/* do it ourselves then */
+		close(fd);
+		return 0;
+	}
+	if (pid > 0) {
+		/* the child holds the lock now */
+		close(fd);
+		if (vflg)
+			fprintf(stderr, "%s: presumed dead, re-probing in background\n",
+				host);
+		return 1;
+	}
+	alarm(0);
+	(void) probe_publish(host, mlist);
+	_exit(0);
+}
+
+/*
+ * Probe coalescing.  With -S, statedir/<server>.lock is held by
+ * whoever is probing the server, and the outcome is left in
+ * statedir/<server>.result.  When many cknfs start at once, the first
+ * one probes and the others wait for its result instead of hitting
+ * the server themselves.
+ */
+
+#define RESULT_TTL	5	/* seconds a published result is trusted */
+
+static int
+result_read(host, mlist)
+/*
+ * Return 1 or -1 if a fresh result is published for host, else 0.
+ * The round trip times it saw are stored in mlist.
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	FILE *fp;
+	int ok = 0;
+	long t = 0, rtt = 0, oprtt = 0;
+	char *file;
+
+	if ((file = state_file(host, ".result")) == NULL ||
+	    (fp = fopen(file, "r")) == NULL)
+		return 0;
+	if (fscanf(fp, "%d %ld %ld %ld", &ok, &t, &rtt, &oprtt) != 4 ||
+	    t > time(NULL) || t + RESULT_TTL < time(NULL))
+		ok = 0;
+	else {
+		mlist->mlist_rtt = rtt;
+		mlist->mlist_oprtt = oprtt;
+	}
+	fclose(fp);
+	if (ok && Dflg)
+		fprintf(stderr, "%s: using published result %d\n", host, ok);
+	return ok;
+}
+
+static int
+probe_publish(host, mlist)
+/*
+ * Probe host and tell everybody.  Caller should hold the lock.
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	int ok = probe_server(host, mlist);
+	char line[64];
+
+	/* out of -d time is no verdict, on others nor on the breaker */
+	if (!ok && sliced(probe_fail))
+		return 0;
+	snprintf(line, sizeof(line), "%d %ld %ld %ld\n", ok ? 1 : -1,
+		 (long)time(NULL), mlist->mlist_rtt, mlist->mlist_oprtt);
+	(void) state_write(host, ".result", line);
+	breaker_record(host, ok);
+	return ok;
+}
+
+static int
+shared_probe(host, mlist)
+/*
+ * Probe host unless another process already is or just did.
+ * Return 1 if ok, 0 if error
+ */
+     const char *host;
+     struct m_mlist *mlist;
+{
+	long deadline;
+	int fd, ok;
+
+	if ((ok = result_read(host, mlist)) != 0)
+		return ok > 0;
+	if ((fd = state_lock(host)) < 0) {
+		ok = probe_server(host, mlist);
+		if (ok || !sliced(probe_fail))
+			breaker_record(host, ok);
+		return ok;
+	}
+	deadline = now_ms() + probe_ms();
+	while (flock(fd, LOCK_EX|LOCK_NB) < 0) {
+		struct timeval tv;
+
+		if (errno != EWOULDBLOCK && errno != EINTR)
+			break;		/* no locking here, go ahead */
+		if ((ok = result_read(host, mlist)) != 0) {
+			close(fd);
+			return ok > 0;
+		}
+		if (now_ms() >= deadline) {
+			/* it may take a few timeouts (portmapper, connect,
+			   NULL), we can't tell it is dead from that */
+			close(fd);
+			if (vflg)
+				fprintf(stderr, "%s: other probe still running, probing ourselves\n",
+					host);
+			return probe_server(host, mlist);
+		}
+		tv.tv_sec = 0;
+		tv.tv_usec = 10000;
+		(void) select(0, NULL, NULL, NULL, &tv);
+	}
+	/* the previous holder may have published while we waited */
+	if ((ok = result_read(host, mlist)) == 0)
+		ok = probe_publish(host, mlist);
+	close(fd);
+	return ok > 0;
+}
+
+static int
+_chknfsmnt(mlist)
+/*
+ * Ping the NFS server indicated by the given mnt entry
+ */
+struct m_mlist *mlist;
+{
+	struct m_mlist *mlist2;
+	int len, ok;
+	static char p[MAXPATHLEN];
+
+	if (Dflg)
+		fprintf(stderr, "chknfsmnt(%s)\n", mlist->mlist_fsname);
+
+	if (mlist->mlist_checked) /* if already checked this mount point */
+		return (mlist->mlist_checked);
+
+	if (mlist->mlist_pid)
+		return check_automount(mlist);
+
+	server_name(mlist->mlist_fsname, p, sizeof(p));
+	len = strlen(p);
+
+	if (Hflg)
+		printf("%s ", p);
+
+	/*
+	 * See if remote host already checked via another mount point
+	 */
+	for (mlist2 = firstmnt; mlist2 != NULL; mlist2 = mlist2->mlist_next)
+		if (strncmp(mlist2->mlist_fsname, p, len) == 0 
+				&& mlist2->mlist_checked) {
+			mlist->mlist_rtt = mlist2->mlist_rtt;
+			mlist->mlist_oprtt = mlist2->mlist_oprtt;
+			return(mlist2->mlist_checked);
+		}
+
+	mlist->mlist_checked = -1; /* set failed */
+	if (statedir && breaker_open(p, mlist))
+		return 0;
+	if (vflg)
+		fprintf(stderr, "Checking %s..\n", p);
+
+	probe_fail = NULL;
+	prof_enter(PROF_PROBE);
+	ok = statedir ? shared_probe(p, mlist) : probe_server(p, mlist);
+	prof_leave();
+	if (!ok) {
+		if (vflg && probe_fail)
+			fprintf(stderr, "%s failed, %s\n", p, probe_fail);
+		if (sliced(probe_fail)) {
+			/* the next path may have the time to find out */
+			slice_cut = 1;
+			mlist->mlist_checked = 0;
+		}
+		return 0;
+	}
+
+	mlist->mlist_checked = 1; /* set success */
+	if (vflg && Rflg && mlist->mlist_oprtt < 0)
+		fprintf(stderr, "%s ok, NULL %ldms, ping only\n", p,
+			mlist->mlist_rtt);
+	else if (vflg && Rflg)
+		fprintf(stderr, "%s ok, NULL %ldms, %s %ldms\n", p,
+			mlist->mlist_rtt,
+			mlist->nfs_version == 4 ? "COMPOUND" : "FSINFO",
+			mlist->mlist_oprtt);
+	else if (vflg)
+		fprintf(stderr, "%s ok, %ldms\n", p, mlist->mlist_rtt);
+	return 1;
+}
+
+static void
+deps_add(d, mlist)
+/*
+ * Add mlist to the dependencies in d, once
+ */
+struct deps *d;
+struct m_mlist *mlist;
+{
+	int i;
+
+	for (i = 0; i < d->n; i++)
+		if (d->m[i] == mlist)
+			return;
+	if (d->n == d->size) {
+		d->size = d->size ? 2 * d->size : 8;
+		d->m = xrealloc(d->m, d->size * sizeof(*d->m));
+	}
+	d->m[d->n++] = mlist;
+}
+
+int
+chknfsmnt(mlist)
+/*
+ * Ping the NFS server, and remember that the current path is remote,
+ * depends on this mount, and how slow its slowest server was
+ */
+struct m_mlist *mlist;
+{
+	int ret;
+	long start = TRACE_US();
+
+	TRACE1(chknfsmnt__entry, mlist->mlist_fsname);
+	ret = _chknfsmnt(mlist);
+	TRACE4(chknfsmnt__return, mlist->mlist_fsname, ret, mlist->mlist_rtt,
+	       TRACE_US() - start);
+
+	path_remote = 1;
+	deps_add(&path_deps, mlist);
+	if (mlist->mlist_rtt > path_rtt)
+		path_rtt = mlist->mlist_rtt;
+	if (mlist->mlist_oprtt > path_oprtt)
+		path_oprtt = mlist->mlist_oprtt;
+	return ret;
+}
+
+static void
+mlist_read()
+/*
+ * Read the mount table
+ */
+{
+	long start = TRACE_US();
+
+	TRACE0(mlist__entry);
+	prof_enter(PROF_MTAB);
+	if (snapfile == NULL || nsroot[0] || !snap_load()) {
+		mkm_mlist();
+		if (snapfile && !nsroot[0])
+			snap_write();
+	}
+	prof_leave();
+	TRACE1(mlist__return, TRACE_US() - start);
+}
+
+static int mlist_loaded;
+
+static void
+mlist_load()
+/*
+ * Read the mount table the first time it's needed
+ */
+{
+	if (mlist_loaded == 0) {
+		++mlist_loaded;
+		mlist_read();
+	}
+}
+
+static void
+mlist_reset()
+/*
+ * Forget the mount table, so the next mlist_load() reads it again
+ */
+{
+	struct m_mlist *mlist;
+
+	while ((mlist = firstmnt) != NULL) {
+		firstmnt = mlist->mlist_next;
+		if (mlist->mlist_snap)
+			continue;
+		if (mlist->mountaddr)
+			freeaddrinfo(mlist->mountaddr);
+		free(mlist->mlist_addr);
+		free(mlist->mlist_dir);
+		free(mlist->mlist_fsname);
+		free(mlist);
+	}
+	snap_unmap();
+	mlist_loaded = 0;
+}
+
+struct m_mlist *
+isnfsmnt(path)
+/*
+ * Return 1 if path is NFS mount point
+ */
+char *path;
+{
+	struct m_mlist *mlist;
+
+	mlist_load();
+
+	TRACE1(isnfsmnt__entry, path);
+	if (Dflg)
+		fprintf(stderr, "isnfsmnt(%s)\n", path);
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		if (mlist->mlist_isnfs == 0 || mlist->mlist_automap)
+			continue;
+		if (strcmp(mlist->mlist_dir, path) == 0) {
+			if (Dflg)
+				fprintf(stderr, "%s: contained in %s mounted from %s\n",
+					path, mlist->mlist_dir, mlist->mlist_fsname);
+			TRACE2(isnfsmnt__return, path, mlist->mlist_fsname);
+			return(mlist);
+		}
+	}
+	TRACE2(isnfsmnt__return, path, (char *)0);
+	return NULL;
+}
+
+/*
+ * Automount maps.  Walking into an autofs directory makes the daemon
+ * mount the entry we look up, which is exactly what hangs if its
+ * server is dead, and costs a mount for every map entry we merely
+ * pass through.  So when the walk is about to step on an autofs entry
+ * which isn't mounted yet, we read the map ourselves, probe the
+ * server it names, and don't touch the entry at all.
+ *
+ * Only file maps, the -hosts map and systemd automounts backed by
+ * /etc/fstab are understood.  Anything else (program maps, NIS, LDAP)
+ * is left to the daemon as before.
+ */
+
+static int
+ismounted(path)
+/*
+ * Return 1 if some real file system is mounted on path
+ */
+	const char *path;
+{
+	struct m_mlist *mlist;
+
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next)
+		if (!mlist->mlist_autofs && !mlist->mlist_automap &&
+		    strcmp(mlist->mlist_dir, path) == 0)
+			return 1;
+	return 0;
+}
+
+static int
+map_line(fp, line, size)
+/*
+ * Read a map line, joining continuation lines.  Return 0 at EOF
+ */
+	FILE *fp;
+	char *line;
+	int size;
+{
+	int len = 0;
+
+	line[0] = '\0';
+	while (fgets(line + len, size - len, fp) != NULL) {
+		len = strlen(line);
+		while (len > 0 && isspace((unsigned char)line[len-1]))
+			line[--len] = '\0';
+		if (len > 0 && line[len-1] == '\\') {
+			line[--len] = '\0';
+			continue;
+		}
+		return 1;
+	}
+	return len > 0;
+}
+
+static int
+map_lookup(mapname, key, location, opts)
+/*
+ * Find key in an automount map.  Copy first location ("host:/path")
+ * and options of the entry.  Return 1 if found
+ */
+	const char *mapname, *key;
+	char *location, *opts;
+{
+	char mapfile[MAXPATHLEN], nsmapfile[MAXPATHLEN + sizeof(nsroot)];
+	char line[BUFSIZ];
+	char *s, *loc, *amp;
+	FILE *fp;
+	struct stat stb;
+
+	if (strncmp(mapname, "file:", 5) == 0)
+		mapname += 5;
+	if (strcmp(mapname, "-hosts") == 0) {
+		/* key is the server, and it must export something */
+		snprintf(location, MAXPATHLEN, "%s:/", key);
+		opts[0] = '\0';
+		return 1;
+	}
+	if (strncmp(mapname, "systemd-", 8) == 0)
+		mapname = "/etc/fstab";
+	else if (*mapname != '/') {
+		snprintf(mapfile, sizeof(mapfile), "/etc/%s", mapname);
+		mapname = mapfile;
+	}
+	/* the map as seen from the -n namespace */
+	snprintf(nsmapfile, sizeof(nsmapfile), "%s%s", nsroot, mapname);
+	/* don't run program maps */
+	if (stat(nsmapfile, &stb) < 0 || (stb.st_mode & 0111))
+		return 0;
+	if ((fp = fopen(nsmapfile, "r")) == NULL)
+		return 0;
+
+	if (Dflg)
+		fprintf(stderr, "looking up %s in %s\n", key, mapname);
+	while (map_line(fp, line, sizeof(line))) {
+		if ((s = strtok(line, " \t")) == NULL || *s == '#' || *s == '+')
+			continue;
+		if (strcmp(mapname, "/etc/fstab") != 0) {
+			/* key [-options] location ... */
+			if (strcmp(s, key) != 0 && strcmp(s, "*") != 0)
+				continue;
+			opts[0] = '\0';
+			if ((loc = strtok(NULL, " \t")) != NULL && *loc == '-') {
+				strncpy(opts, loc + 1, BUFSIZ - 1);
+				opts[BUFSIZ - 1] = '\0';
+				loc = strtok(NULL, " \t");
+			}
+			/* multi-mount entry, take the root offset */
+			if (loc != NULL && *loc == '/')
+				loc = strtok(NULL, " \t");
+		} else {
+			/* fstab: fsname dir type options */
+			loc = s;
+			if ((s = strtok(NULL, " \t")) == NULL || strcmp(s, key) != 0)
+				continue;
+			if ((s = strtok(NULL, " \t")) == NULL || strncmp(s, "nfs", 3) != 0)
+				break;
+			snprintf(opts, BUFSIZ, "fstype=%s", s);
+			if ((s = strtok(NULL, " \t")) != NULL) {
+				strncat(opts, ",", BUFSIZ - strlen(opts) - 1);
+				strncat(opts, s, BUFSIZ - strlen(opts) - 1);
+			}
+		}
+		if (loc == NULL || strchr(loc, ':') == NULL)
+			break;
+		/* "*" entries substitute the key for & */
+		if ((amp = strchr(loc, '&')) != NULL) {
+			*amp = '\0';
+			snprintf(location, MAXPATHLEN, "%s%s%s", loc, key, amp + 1);
+		} else
+			strncpy(location, loc, MAXPATHLEN - 1);
+		location[MAXPATHLEN - 1] = '\0';
+		/* replicated servers: "a,b:/path", check the first one */
+		if ((s = strchr(location, ',')) != NULL && s < strchr(location, ':'))
+			memmove(s, strchr(location, ':'), strlen(strchr(location, ':')) + 1);
+		/* strip weight "host(5):/path" */
+		if ((s = strchr(location, '(')) != NULL && s < strchr(location, ':'))
+			memmove(s, strchr(s, ':'), strlen(strchr(s, ':')) + 1);
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static struct m_mlist *
+automap(path)
+/*
+ * Return made up mount entry for path if it's an autofs entry that is
+ * not mounted yet and its map says it's NFS.  Else NULL
+ */
+	const char *path;
+{
+	struct m_mlist *mlist, *autofs = NULL;
+	char parent[MAXPATHLEN];
+	char location[MAXPATHLEN];
+	char opts[BUFSIZ];
+	const char *key = path, *fstype;
+	char *s;
+
+	mlist_load();
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next)
+		if (mlist->mlist_automap && strcmp(mlist->mlist_dir, path) == 0)
+			return mlist;
+
+	strncpy(parent, path, sizeof(parent) - 1);
+	parent[sizeof(parent) - 1] = '\0';
+	if ((s = strrchr(parent, '/')) != NULL) {
+		*s = '\0';
+		key = s + 1;
+		if (parent[0] == '\0')
+			strcpy(parent, "/");
+	}
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		if (mlist->mlist_autofs == AUTOFS_DIRECT &&
+		    strcmp(mlist->mlist_dir, path) == 0) {
+			key = path;
+			autofs = mlist;
+			break;
+		}
+		if (mlist->mlist_autofs == AUTOFS_INDIRECT &&
+		    strcmp(mlist->mlist_dir, parent) == 0)
+			autofs = mlist;
+	}
+	if (autofs == NULL || ismounted(path))
+		return NULL;
+
+	if (!map_lookup(autofs->mlist_fsname, key, location, opts)) {
+		if (vflg)
+			fprintf(stderr, "%s: not found in map %s, leaving it to automount\n",
+				path, autofs->mlist_fsname);
+		return NULL;
+	}
+	fstype = find_opt_val(opts, "fstype");
+	if (fstype && strncmp(fstype, "nfs", 3) != 0)
+		return NULL;
+	if (Dflg)
+		fprintf(stderr, "%s: unmounted autofs entry for %s\n", path, location);
+
+	mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
+	memset(mlist, 0, sizeof(*mlist));
+	mlist->mlist_dir = xalloc(strlen(path) + 1);
+	strcpy(mlist->mlist_dir, path);
+	mlist->mlist_fsname = xalloc(strlen(location) + 1);
+	strcpy(mlist->mlist_fsname, location);
+	mlist->mlist_isnfs = 1;
+	mlist->mlist_automap = 1;
+	mlist->nfs_version = fstype && strncmp(fstype, "nfs4", 4) == 0 ? 4 : 3;
+	nfs_opts(mlist, location, opts);
+	mlist->mlist_next = firstmnt;
+	firstmnt = mlist;
+	return mlist;
+}
+
+typedef void (*sighandler_t)(int);
+
+#define NTERMS 256
+
+jmp_buf alarmclock;
+
+void
+sigalrm(signum)
+	int signum;
+{
+	if (Dflg)
+		fprintf(stderr, "caught signal %d\n", signum);
+	longjmp(alarmclock, 1);
+}
+
+static int
+prefix_add(s)
+/*
+ * Add component s to prefix.  Return 0 if it doesn't fit
+ */
+char *s;
+{
+	size_t len = strlen(prefix);
+
+	if (len + strlen(s) + 2 > sizeof(prefix)) {
+		fprintf(stderr, "%s/%s: File name too long\n", prefix, s);
+		return 0;
+	}
+	prefix[len] = '/';
+	strcpy(prefix + len + 1, s);
+	return 1;
+}
+
+int
+_chkpath(path, maxdepth)
+char *path;
+int maxdepth;
+{
+	char *s, *s2;
+	int i, front=0, back=0;
+	struct stat stb;
+	struct m_mlist *mlist;
+	char p[MAXPATHLEN];
+	char symlink[MAXPATHLEN];
+	char *queue[NTERMS];
+	long start;
+	int depth;
+
+	if (maxdepth == 0) {
+		fprintf(stderr,
+			"%s: Too many levels of symbolic links\n", path);
+		return 0;
+	}
+	/*
+	 * Copy path to working storage
+	 */
+	strncpy(p, path, sizeof(p)-1);
+
+	if (*p == '/') { /* If absolute path, start at root */
+		*prefix = '\0';
+		(void) chdir(*nsroot ? nsroot : "/");
+	}
+
+	if (Dflg)
+		fprintf(stderr, "_chkpath(%s, %d) prefix=%s\n",
+			path, maxdepth, prefix);
+	/*
+	 * Put directory terms on FIFO queue
+	 */
+	for (s = strtok(p, "/"); s != NULL; s = strtok((char *)NULL, "/")) {
+		if (back >= NTERMS) {
+			fprintf(stderr, "Too many subdirs: %s\n", path);
+			goto fail;
+		}
+		queue[back++] = s;
+	}
+	/*  queue[front] = a, queue[front+1] = b, ... queue[back] = null */
+
+	/* The code below may make some unsafe calls to stat, so set
+	 * the alarm to catch problems.
+	 */
+	signal(SIGALRM, sigalrm);
+	path_alarm();
+	depth = prof_depth;
+	if (setjmp(alarmclock)) {
+		/* out of a probe or lookup, maybe */
+		prof_unwind(depth);
+		if (sliced("timeout"))
+			slice_cut = 1;
+		goto fail;
+	}
+
+	/*
+	 * Scan queue of directory terms, expanding 
+	 * symbolic links recursively.
+	 */
+	while (front != back) {
+		s = queue[front++];
+		/* Dot */
+		if (s[0] == '.' && s[1] == '\0')
+			continue;
+		/* Dot Dot */
+		if (s[0] == '.' && s[1] == '.' && s[2] == '\0') {
+			/* don't climb out of the -n namespace's root */
+			if (chdir(*prefix || !*nsroot ? ".." : nsroot) < 0) {
+				perror("chdir(..)");
+				goto fail;
+			}
+			/* Remove trailing component of prefix */
+			if ((s2 = strrchr(prefix, '/')) != NULL)
+				*s2 = '\0';
+			continue;
+		} else if (!prefix_add(s))
+			goto fail;
+
+		if ((mlist = automap(prefix)) != NULL) {
+			/* Not mounted yet.  Don't trigger the automounter,
+			   the rest of the path lives on this server, but
+			   can't be looked up without mounting it. */
+			if (chknfsmnt(mlist) <= 0)
+				goto fail;
+			if (vflg && front != back)
+				fprintf(stderr, "%s: %s not mounted, rest of path not checked\n",
+					path, prefix);
+			while (front != back) {
+				s = queue[front++];
+				if (s[0] == '.' && s[1] == '\0')
+					continue;
+				if (s[0] == '.' && s[1] == '.' && s[2] == '\0') {
+					if ((s2 = strrchr(prefix, '/')) != NULL)
+						*s2 = '\0';
+					continue;
+				}
+				if (!prefix_add(s))
+					goto fail;
+			}
+			alarm(0);
+			return 1;
+		}
+		if ((mlist = isnfsmnt(prefix)) != NULL) /* NFS mount? */
+			if (chknfsmnt(mlist) <= 0)
+				goto fail;
+		/* Check if symlink */
+		TRACE1(walk__step, prefix);
+		start = TRACE_US();
+#ifdef AT_NO_AUTOMOUNT
+		i = fstatat(AT_FDCWD, s, &stb, AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT);
+#else
+		i = lstat(s, &stb);
+#endif
+		TRACE3(walk__step__return, prefix, i < 0 ? errno : 0,
+		       TRACE_US() - start);
+		if (i < 0) {
+			if (errno != ENOENT || !qflg)
+				perror(prefix);
+			goto fail;
+		}
+		if ((stb.st_mode & S_IFMT) != S_IFLNK) {
+			/* not symlink */
+			if (chdir(s) < 0) {
+				if (fflg) {
+					alarm(0);
+					return 1;
+				}
+				perror(prefix);
+				goto fail;
+			}
+			continue;
+		}
+
+		/* Remove symlink from tail of prefix */
+		if ((s2 = strrchr(prefix, '/')) != NULL)
+			*s2 = '\0';
+		/* 
+		 * Read symlink
+		 */
+		if ((i = readlink(s, symlink, MAXPATHLEN-1)) < 0) {
+			perror(s);
+			goto fail;
+		}
+		symlink[i] = '\0'; /* null terminate */
+
+		/*
+		 * Recursively check symlink
+		 */
+
+		if (_chkpath(symlink, maxdepth-1) == 0)
+			goto fail;
+	}
+	alarm(0);
+	return 1;
+
+fail:
+	alarm(0);
+	return 0;
+}
+	
+/*
+ * Server dependencies.  Every NFS mount a path goes through, on the
+ * way to it, in symbolic link targets, and above where it ends up, is
+ * a server the path needs.  The walk collects them in path_deps, and
+ * with -S they are kept in statedir/deps for each absolute path:
+ *
+ *	mtab <hash of the mount table>
+ *	path<TAB>mount point<TAB>mount point...
+ *
+ * The next run probes the servers of all its paths first, and skips
+ * a path that needs a dead one without touching the file system.
+ * The file is thrown away when the mount table changes.
+ */
+
+#define DEPS_MAX	1000	/* paths remembered */
+
+struct dep_entry {
+	struct dep_entry *next;
+	char *path;
+	char *dirs;		/* mount points, tab separated */
+};
+
+static int snap_key();
+static struct dep_entry *deps_cache;
+static int deps_on;		/* statedir/deps is in use */
+static int deps_changed;	/* and has to be written */
+
+static void
+arg_paths(args, nargs, fn, arg)
+/*
+ * Call fn(path, arg) for every path in the arguments that chkpath
+ * will see, split like check_list does
+ */
+char **args;
+int nargs;
+void (*fn)();
+char *arg;
+{
+	char *s, *colon;
+	int i;
+
+	for (i = 0; i < nargs; i++) {
+		s = args[i];
+		if (aflg && (s = strchr(s, '=')) == NULL)
+			continue;
+		s = strdup(aflg ? s + 1 : s);
+		do {
+			colon = (sflg || aflg) ? strchr(s, ':') : NULL;
+			if (colon)
+				*colon = '\0';
+			if (*s && *s != '.')
+				(*fn)(s, arg);
+			s = colon + 1;
+		} while (colon);
+	}
+}
+
+static void
+deps_load()
+/*
+ * Read statedir/deps, if it was written for this mount table
+ */
+{
+	char file[MAXPATHLEN], line[4 * MAXPATHLEN], *tab;
+	unsigned long long hash;
+	struct dep_entry *e, **last = &deps_cache;
+	FILE *fp;
+
+	if (statedir == NULL || nsroot[0] || !snap_key())
+		return;
+	deps_on = 1;
+	snprintf(file, sizeof(file), "%s/deps", statedir);
+	if ((fp = fopen(file, "r")) == NULL)
+		return;
+	if (fgets(line, sizeof(line), fp) == NULL ||
+	    sscanf(line, "mtab %llx", &hash) != 1 || hash != snap_hash) {
+		if (Dflg)
+			fprintf(stderr, "%s: mount table changed\n", file);
+		deps_changed = 1;
+		fclose(fp);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		tab = strchr(line, '\t');
+		e = xalloc(sizeof(*e));
+		e->next = NULL;
+		e->dirs = strdup(tab ? tab + 1 : "");
+		if (tab)
+			*tab = '\0';
+		e->path = strdup(line);
+		*last = e;
+		last = &e->next;
+	}
+	fclose(fp);
+}
+
+static struct dep_entry *
+deps_find(path)
+char *path;
+{
+	struct dep_entry *e;
+
+	if (!deps_on || *path != '/')
+		return NULL;
+	for (e = deps_cache; e != NULL; e = e->next)
+		if (strcmp(e->path, path) == 0)
+			return e;
+	return NULL;
+}
+
+static struct m_mlist *
+deps_mount(dir)
+/*
+ * The NFS mount, or automount map entry, at dir
+ */
+char *dir;
+{
+	struct m_mlist *mlist;
+
+	mlist_load();
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next)
+		if (mlist->mlist_isnfs && strcmp(mlist->mlist_dir, dir) == 0)
+			return mlist;
+	return automap(dir);
+}
+
+static struct m_mlist *
+deps_each(e, fn)
+/*
+ * Call fn(mlist) for each mount remembered in e, until it returns 0.
+ * Return the mount it did that for, or NULL
+ */
+struct dep_entry *e;
+int (*fn)();
+{
+	char dir[MAXPATHLEN], *s = e->dirs;
+	struct m_mlist *mlist;
+	int len;
+
+	while (*s) {
+		len = strcspn(s, "\t");
+		if (len < sizeof(dir)) {
+			memcpy(dir, s, len);
+			dir[len] = '\0';
+			if ((mlist = deps_mount(dir)) != NULL && !(*fn)(mlist))
+				return mlist;
+		}
+		s += len;
+		if (*s)
+			s++;
+	}
+	return NULL;
+}
+
+static int
+deps_probe(mlist)
+struct m_mlist *mlist;
+{
+	(void) chknfsmnt(mlist);
+	return 1;
+}
+
+static int
+deps_alive(mlist)
+struct m_mlist *mlist;
+{
+	return mlist->mlist_checked >= 0;
+}
+
+static int
+deps_collect(mlist)
+struct m_mlist *mlist;
+{
+	deps_add(&path_deps, mlist);
+	return 1;
+}
+
+static void
+deps_prefetch(path, unused)
+/*
+ * Probe the servers path needed last time
+ */
+char *path, *unused;
+{
+	struct dep_entry *e;
+
+	if ((e = deps_find(path)) != NULL)
+		(void) deps_each(e, deps_probe);
+}
+
+static int
+deps_dead(path)
+/*
+ * Return 1 if path needed a server that is now known to be dead,
+ * and make its remembered mounts path_deps, its prefix the path
+ */
+char *path;
+{
+	struct dep_entry *e;
+	struct m_mlist *mlist;
+
+	if ((e = deps_find(path)) == NULL ||
+	    (mlist = deps_each(e, deps_alive)) == NULL)
+		return 0;
+	if (vflg)
+		fprintf(stderr, "%s: needs %s, which is dead\n",
+			path, mlist->mlist_fsname);
+	(void) deps_each(e, deps_collect);
+	path_remote = 1;
+	strncpy(prefix, path, sizeof(prefix) - 1);
+	return 1;
+}
+
+static int
+deps_parents(path)
+/*
+ * Add the NFS mounts above the real path to path_deps, the ones the
+ * walk didn't go through because it started below them (relative
+ * paths) or at the root, and ping their servers.  Return 0 if one
+ * is dead
+ */
+char *path;
+{
+	struct m_mlist *mlist, *m2;
+	int len, ok = 1;
+
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		if (!mlist->mlist_isnfs || mlist->mlist_automap)
+			continue;
+		len = strlen(mlist->mlist_dir);
+		if (strncmp(mlist->mlist_dir, path, len) != 0 ||
+		    (path[len] != '/' && path[len] != '\0' &&
+		     strcmp(mlist->mlist_dir, "/") != 0))
+			continue;
+		/* only the last mount on a directory counts */
+		for (m2 = firstmnt; m2 != mlist; m2 = m2->mlist_next)
+			if (strcmp(m2->mlist_dir, mlist->mlist_dir) == 0)
+				break;
+		if (m2 == mlist && chknfsmnt(mlist) <= 0)
+			ok = 0;
+	}
+	return ok;
+}
+
+static void
+deps_remember(path)
+/*
+ * Keep path_deps for path in statedir/deps
+ */
+char *path;
+{
+	struct dep_entry *e, **ep;
+	char dirs[4 * MAXPATHLEN];
+	int i, n = 0;
+
+	if (!deps_on || *path != '/' || strpbrk(path, "\t\n"))
+		return;
+	dirs[0] = '\0';
+	for (i = 0; i < path_deps.n; i++) {
+		if (strpbrk(path_deps.m[i]->mlist_dir, "\t\n") ||
+		    n + strlen(path_deps.m[i]->mlist_dir) + 2 > sizeof(dirs))
+			return;
+		n += sprintf(dirs + n, "%s%s", i ? "\t" : "",
+			     path_deps.m[i]->mlist_dir);
+	}
+	for (ep = &deps_cache; (e = *ep) != NULL; ep = &e->next)
+		if (strcmp(e->path, path) == 0)
+			break;
+	if (e != NULL) {
+		if (strcmp(e->dirs, dirs) == 0)
+			return;
+		*ep = e->next;
+		free(e->dirs);
+	} else {
+		e = xalloc(sizeof(*e));
+		e->path = strdup(path);
+	}
+	/* most recent first, the oldest fall off the end */
+	e->dirs = strdup(dirs);
+	e->next = deps_cache;
+	deps_cache = e;
+	deps_changed = 1;
+}
+
+static void
+deps_write()
+/*
+ * Replace statedir/deps, if anything changed
+ */
+{
+	char file[MAXPATHLEN], tmp[MAXPATHLEN + 16];
+	struct dep_entry *e;
+	FILE *fp;
+	int n = 0;
+
+	if (!deps_changed)
+		return;
+	snprintf(file, sizeof(file), "%s/deps", statedir);
+	if ((fp = tmp_create(file, tmp, sizeof(tmp))) == NULL)
+		return;
+	fprintf(fp, "mtab %016llx\n", (unsigned long long)snap_hash);
+	for (e = deps_cache; e != NULL && n < DEPS_MAX; e = e->next, n++)
+		fprintf(fp, "%s\t%s\n", e->path, e->dirs);
+	if (fclose(fp) != 0 || rename(tmp, file) != 0) {
+		perror(file);
+		(void) unlink(tmp);
+	}
+}
+
+static void
+deps_print(path)
+/*
+ * -G: print the NFS mounts path depends on
+ */
+char *path;
+{
+	struct m_mlist *mlist;
+	int i;
+
+	printf("%s:", path);
+	if (path_deps.n == 0)
+		printf(" local");
+	for (i = 0; i < path_deps.n; i++) {
+		mlist = path_deps.m[i];
+		printf("%s %s on %s%s", i ? "," : "", mlist->mlist_fsname,
+		       mlist->mlist_dir, mlist->mlist_checked < 0 ? " (dead)" : "");
+	}
+	putchar('\n');
+}
+
+/*
+ * Incremental mode (-i), for running from a prompt hook.  The file
+ * keeps the paths of the last run with their verdicts, real paths and
+ * servers, and the verdicts of those servers:
+ *
+ *	mtab <hash of the mount table>
+ *	s <ok> <when> <rtt> <oprtt> <host>
+ *	p <verdict> <when><TAB>path<TAB>prefix[<TAB>mount point<TAB>host]...
+ *
+ * A path seen before is taken from the file, unless one of its servers
+ * was checked more than INC_SERVER_TTL ago, in which case only that
+ * server is pinged again, or the path itself is older than INC_PATH_TTL.
+ * When nothing has expired, the mount table isn't even parsed.
+ */
+
+#define INC_SERVER_TTL	10000	/* ms a server verdict is trusted */
+#define INC_PATH_TTL	60000	/* and a path's */
+
+struct inc_server {
+	struct inc_server *next;
+	char *host;
+	int ok;
+	long long when;
+	long rtt, oprtt;
+};
+
+struct inc_path {
+	struct inc_path *next;
+	char *path;
+	char *prefix;		/* real path, for -L and -u */
+	int verdict;		/* 1 good, 0 bad, -1 needs a dead server */
+	long long when;
+	int used;		/* in this run */
+	int ndeps;
+	char **dirs;		/* mount points it depends on */
+	char **hosts;		/* and their servers */
+};
+
+static char *incfile;		/* -i, state of the last run */
+static int inc_on, inc_changed;
+static struct inc_server *inc_servers;
+static struct inc_path *inc_paths;
+
+static struct inc_server *
+inc_server(host, create)
+char *host;
+int create;
+{
+	struct inc_server *s;
+
+	for (s = inc_servers; s != NULL; s = s->next)
+		if (strcmp(s->host, host) == 0)
+			return s;
+	if (!create)
+		return NULL;
+	s = xalloc(sizeof(*s));
+	memset(s, 0, sizeof(*s));
+	s->host = strdup(host);
+	s->next = inc_servers;
+	inc_servers = s;
+	return s;
+}
+
+static struct inc_path *
+inc_path(path)
+char *path;
+{
+	struct inc_path *p;
+
+	for (p = inc_paths; p != NULL; p = p->next)
+		if (strcmp(p->path, path) == 0)
+			return p;
+	return NULL;
+}
+
+static void
+inc_load()
+/*
+ * Read the state of the last run, if the mount table is the same
+ */
+{
+	char line[4 * MAXPATHLEN], host[MAXPATHLEN], *s, *field[64];
+	unsigned long long hash;
+	struct inc_server *srv;
+	struct inc_path *p;
+	long long when;
+	long rtt, oprtt;
+	int ok, n;
+	FILE *fp;
+
+	if (incfile == NULL || nsroot[0] || Gflg || !snap_key())
+		return;
+	inc_on = 1;
+	if ((fp = fopen(incfile, "r")) == NULL)
+		return;
+	if (fgets(line, sizeof(line), fp) == NULL ||
+	    sscanf(line, "mtab %llx", &hash) != 1 || hash != snap_hash) {
+		if (Dflg)
+			fprintf(stderr, "%s: mount table changed\n", incfile);
+		inc_changed = 1;
+		fclose(fp);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (sscanf(line, "s %d %lld %ld %ld %1023s",
+			   &ok, &when, &rtt, &oprtt, host) == 5) {
+			srv = inc_server(host, 1);
+			srv->ok = ok;
+			srv->when = when;
+			srv->rtt = rtt;
+			srv->oprtt = oprtt;
+			continue;
+		}
+		if (sscanf(line, "p %d %lld", &ok, &when) != 2 ||
+		    (s = strchr(line, '\t')) == NULL)
+			continue;
+		for (n = 0, s++; s != NULL && n < 64; n++)
+			field[n] = strsep(&s, "\t");
+		if (n < 2 || n % 2)
+			continue;
+		p = xalloc(sizeof(*p));
+		memset(p, 0, sizeof(*p));
+		p->path = strdup(field[0]);
+		p->prefix = strdup(field[1]);
+		p->verdict = ok;
+		p->when = when;
+		p->ndeps = (n - 2) / 2;
+		p->dirs = xalloc(p->ndeps * sizeof(char *) + 1);
+		p->hosts = xalloc(p->ndeps * sizeof(char *) + 1);
+		for (n = 0; n < p->ndeps; n++) {
+			p->dirs[n] = strdup(field[2 + 2 * n]);
+			p->hosts[n] = strdup(field[3 + 2 * n]);
+		}
+		p->next = inc_paths;
+		inc_paths = p;
+	}
+	fclose(fp);
+}
+
+static int
+inc_lookup(path, ret)
+/*
+ * Take path's verdict from the last run, pinging again the servers
+ * whose verdict expired, and set *ret, prefix and the path_* globals
+ * like chkpath would.  Return 0 if path has to be walked
+ */
+char *path;
+int *ret;
+{
+	struct inc_path *p;
+	struct inc_server *srv;
+	struct m_mlist *mlist;
+	long long now;
+	int i, down = 0;
+
+	if (!inc_on || *path != '/' || (p = inc_path(path)) == NULL)
+		return 0;
+	now = wall_ms();
+	if (now - p->when > INC_PATH_TTL || now < p->when)
+		return 0;
+	for (i = 0; i < p->ndeps; i++) {
+		if ((srv = inc_server(p->hosts[i], 0)) == NULL)
+			return 0;
+		if (now - srv->when > INC_SERVER_TTL || now < srv->when) {
+			if ((mlist = deps_mount(p->dirs[i])) == NULL)
+				return 0;
+			srv->ok = chknfsmnt(mlist) > 0;
+			srv->when = now;
+			srv->rtt = mlist->mlist_rtt;
+			srv->oprtt = mlist->mlist_oprtt;
+			inc_changed = 1;
+		}
+		if (!srv->ok)
+			down = 1;
+	}
+	if (!down && p->verdict < 0)
+		return 0;	/* its servers are back, look again */
+
+	p->used = 1;
+	path_remote = p->ndeps > 0;
+	path_rtt = path_oprtt = 0;
+	for (i = 0; i < p->ndeps; i++) {
+		srv = inc_server(p->hosts[i], 0);
+		if (srv->rtt > path_rtt)
+			path_rtt = srv->rtt;
+		if (srv->oprtt > path_oprtt)
+			path_oprtt = srv->oprtt;
+	}
+	strcpy(prefix, p->prefix);
+	if (down) {
+		if (vflg && p->verdict >= 0)
+			fprintf(stderr, "%s: needs a dead server\n", path);
+		if (p->verdict != -1)
+			inc_changed = 1;
+		p->verdict = -1;
+	}
+	*ret = p->verdict > 0;
+	if (Dflg)
+		fprintf(stderr, "%s: %s from %s\n", path,
+			*ret ? "good" : "bad", incfile);
+	return 1;
+}
+
+static void
+inc_record(path, ret)
+/*
+ * Keep what chkpath found out about path
+ */
+char *path;
+int ret;
+{
+	struct inc_path *p;
+	struct inc_server *srv;
+	struct m_mlist *mlist;
+	char host[MAXPATHLEN];
+	long long now = wall_ms();
+	int i, down = 0;
+
+	if (!inc_on || *path != '/' || strpbrk(path, "\t\n") ||
+	    strpbrk(prefix, "\t\n"))
+		return;
+	for (i = 0; i < path_deps.n; i++)
+		if (strpbrk(path_deps.m[i]->mlist_dir, "\t\n"))
+			return;
+	if ((p = inc_path(path)) == NULL) {
+		p = xalloc(sizeof(*p));
+		memset(p, 0, sizeof(*p));
+		p->path = strdup(path);
+		p->next = inc_paths;
+		inc_paths = p;
+	} else {
+		free(p->prefix);
+		for (i = 0; i < p->ndeps; i++) {
+			free(p->dirs[i]);
+			free(p->hosts[i]);
+		}
+		free(p->dirs);
+		free(p->hosts);
+	}
+	p->prefix = strdup(prefix);
+	p->when = now;
+	p->used = 1;
+	p->ndeps = path_deps.n;
+	p->dirs = xalloc(p->ndeps * sizeof(char *) + 1);
+	p->hosts = xalloc(p->ndeps * sizeof(char *) + 1);
+	for (i = 0; i < path_deps.n; i++) {
+		mlist = path_deps.m[i];
+		server_name(mlist->mlist_fsname, host, sizeof(host));
+		p->dirs[i] = strdup(mlist->mlist_dir);
+		p->hosts[i] = strdup(host);
+		if (mlist->mlist_checked == 0)
+			continue;
+		srv = inc_server(host, 1);
+		srv->ok = mlist->mlist_checked > 0;
+		srv->when = now;
+		srv->rtt = mlist->mlist_rtt;
+		srv->oprtt = mlist->mlist_oprtt;
+		if (!srv->ok)
+			down = 1;
+	}
+	p->verdict = ret ? 1 : down ? -1 : 0;
+	inc_changed = 1;
+}
+
+static void
+inc_write()
+/*
+ * Replace the state file with this run's paths and their servers
+ */
+{
+	char tmp[MAXPATHLEN + 16];
+	struct inc_path *p;
+	struct inc_server *srv;
+	FILE *fp;
+	int i;
+
+	for (p = inc_paths; p != NULL; p = p->next)
+		if (!p->used)
+			inc_changed = 1;	/* gone from the input */
+	if (!inc_changed)
+		return;
+	if ((fp = tmp_create(incfile, tmp, sizeof(tmp))) == NULL)
+		return;
+	fprintf(fp, "mtab %016llx\n", (unsigned long long)snap_hash);
+	for (srv = inc_servers; srv != NULL; srv = srv->next) {
+		/* only the servers of this run's paths */
+		for (p = inc_paths; p != NULL; p = p->next) {
+			for (i = 0; p->used && i < p->ndeps; i++)
+				if (strcmp(p->hosts[i], srv->host) == 0)
+					break;
+			if (p->used && i < p->ndeps)
+				break;
+		}
+		if (p != NULL && srv->when)
+			fprintf(fp, "s %d %lld %ld %ld %s\n", srv->ok,
+				srv->when, srv->rtt, srv->oprtt, srv->host);
+	}
+	for (p = inc_paths; p != NULL; p = p->next) {
+		if (!p->used)
+			continue;
+		fprintf(fp, "p %d %lld\t%s\t%s", p->verdict, p->when,
+			p->path, p->prefix);
+		for (i = 0; i < p->ndeps; i++)
+			fprintf(fp, "\t%s\t%s", p->dirs[i], p->hosts[i]);
+		putc('\n', fp);
+	}
+	if (fclose(fp) != 0 || rename(tmp, incfile) != 0) {
+		perror(incfile);
+		(void) unlink(tmp);
+	}
+}
+
+/*
+ * io_uring path walker (-U).  The walker above does one blocking
+ * lookup at a time, with chdir in between, under an alarm that can't
+ * interrupt a lookup stuck on a hard mount.  This one walks all the
+ * argument paths at once: every round, the next component of each
+ * path is looked up with statx, all in one io_uring submission, each
+ * linked to its own timeout.  A lookup that hangs costs its path only:
+ * the timeout bounds our wait for the result, not the kernel work,
+ * and a statx stuck in an io-wq worker on a hard mount still holds
+ * up the exit while the ring is torn down.  The rules are those of
+ * _chkpath: servers are pinged before their mounts are entered,
+ * symbolic links are read and their targets walked, and ".." takes
+ * off the last component of the real path so far.
+ *
+ * Paths are looked up in full from the root, so no chdir is needed.
+ * Without io_uring (old kernel, or disabled by the administrator)
+ * the paths are walked one by one as before.
+ */
+#if defined(linux) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_URING
+#endif
+
+#ifdef HAVE_URING
+#define UR_ENTRIES	256	/* submission queue entries */
+#define UR_BATCH	(UR_ENTRIES / 2) /* lookups per submission */
+
+#define UR_WALK	0	/* walk states */
+#define UR_OK	1
+#define UR_FAIL	2
+
+struct ur_walk {
+	char *path;		/* the argument */
+	char prefix[MAXPATHLEN]; /* real path so far */
+	char rest[MAXPATHLEN];	/* and what is left to walk */
+	int pos;		/* of the next component in rest */
+	int state;
+	int links;		/* symbolic links followed */
+	int inflight;		/* lookup submitted, no answer yet */
+	unsigned seq;		/* lookups submitted, to tell stale answers */
+	int remote;		/* path_remote, path_rtt, path_oprtt */
+	int cut;		/* and slice_cut */
+	long rtt, oprtt;
+	struct deps deps;	/* and path_deps */
+	struct statx stx;
+};
+
+static struct ur_walk *ur_w;	/* one per argument path */
+static int ur_n, ur_next;
+
+static struct {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} ur;
+
+static int
+ur_setup()
+/*
+ * Make the ring.  Return 0 if the kernel can't do statx with linked
+ * timeouts through io_uring
+ */
+{
+	struct io_uring_params p;
+	struct io_uring_probe *probe;
+	size_t sqsize, cqsize, size;
+	char *sq, *cq;
+	int ok;
+
+	memset(&p, 0, sizeof(p));
+	if ((ur.fd = syscall(__NR_io_uring_setup, UR_ENTRIES, &p)) < 0)
+		return 0;
+	size = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = xalloc(size);
+	memset(probe, 0, size);
+	ok = syscall(__NR_io_uring_register, ur.fd, IORING_REGISTER_PROBE,
+		     probe, 256) == 0 &&
+		probe->last_op >= IORING_OP_STATX &&
+		(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+		(probe->ops[IORING_OP_LINK_TIMEOUT].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	if (!ok) {
+		close(ur.fd);
+		return 0;
+	}
+
+	sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		size = sqsize > cqsize ? sqsize : cqsize;
+		sq = cq = mmap(NULL, size, PROT_READ|PROT_WRITE,
+			       MAP_SHARED|MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+	} else {
+		sq = mmap(NULL, sqsize, PROT_READ|PROT_WRITE,
+			  MAP_SHARED|MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+		cq = mmap(NULL, cqsize, PROT_READ|PROT_WRITE,
+			  MAP_SHARED|MAP_POPULATE, ur.fd, IORING_OFF_CQ_RING);
+	}
+	ur.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		       ur.fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || ur.sqes == MAP_FAILED) {
+		close(ur.fd);
+		return 0;
+	}
+	ur.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ur.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ur.sq_array = (unsigned *)(sq + p.sq_off.array);
+	ur.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ur.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ur.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ur.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 1;
+}
+
+static struct io_uring_sqe *
+ur_sqe(tail)
+/*
+ * Clear and return the submission queue entry at *tail, and advance it
+ */
+unsigned *tail;
+{
+	unsigned i = (*tail)++ & *ur.sq_mask;
+
+	ur.sq_array[i] = i;
+	memset(&ur.sqes[i], 0, sizeof(ur.sqes[i]));
+	return &ur.sqes[i];
+}
+
+static int
+ur_server(w, mlist)
+/*
+ * Ping the server of mlist for walk w
+ */
+struct ur_walk *w;
+struct m_mlist *mlist;
+{
+	int ret;
+
+	path_remote = w->remote;
+	path_rtt = w->rtt;
+	path_oprtt = w->oprtt;
+	slice_cut = 0;
+	ret = chknfsmnt(mlist);
+	deps_add(&w->deps, mlist);
+	w->remote = path_remote;
+	w->rtt = path_rtt;
+	w->oprtt = path_oprtt;
+	w->cut |= slice_cut;
+	return ret > 0;
+}
+
+static char *
+ur_component(w)
+/*
+ * Take the next component off w->rest and add it to w->prefix, or
+ * take off the last one for "..".  Return NULL at the end of the
+ * path, else the component, "." or ".." for those
+ */
+struct ur_walk *w;
+{
+	char *s = w->rest + w->pos, *s2;
+	int len;
+
+	while (*s == '/')
+		s++;
+	if (*s == '\0')
+		return NULL;
+	len = strcspn(s, "/");
+	w->pos = s + len - w->rest;
+	if (len == 1 && s[0] == '.')
+		return ".";
+	if (len == 2 && s[0] == '.' && s[1] == '.') {
+		if ((s2 = strrchr(w->prefix, '/')) != NULL)
+			*s2 = '\0';
+		return "..";
+	}
+	if (strlen(w->prefix) + len + 2 > sizeof(w->prefix)) {
+		fprintf(stderr, "%s: File name too long\n", w->path);
+		w->state = UR_FAIL;
+		return NULL;
+	}
+	s2 = w->prefix + strlen(w->prefix);
+	*s2++ = '/';
+	memcpy(s2, s, len);
+	s2[len] = '\0';
+	return s2;
+}
+
+static int
+ur_step(w)
+/*
+ * Walk w on to its next component that has to be looked up.  Return
+ * 1 if there is one, 0 if the walk is over
+ */
+struct ur_walk *w;
+{
+	struct m_mlist *mlist;
+	char *s;
+	int depth = prof_depth;
+
+	/* pings and the access check are not done by the ring, so
+	   they get the alarm of the other walker */
+	signal(SIGALRM, sigalrm);
+	path_alarm();
+	if (setjmp(alarmclock)) {
+		prof_unwind(depth);
+		fprintf(stderr, "%s: timed out\n", w->prefix);
+		w->cut |= sliced("timeout");
+		w->state = UR_FAIL;
+		return 0;
+	}
+	while (w->state == UR_WALK) {
+		if ((s = ur_component(w)) == NULL) {
+			if (w->state != UR_WALK)
+				break;
+			/* chdir would need search permission */
+			if (*w->prefix && !fflg &&
+			    faccessat(AT_FDCWD, w->prefix, X_OK, AT_EACCESS) < 0) {
+				perror(w->prefix);
+				w->state = UR_FAIL;
+			} else
+				w->state = UR_OK;
+			break;
+		}
+		if (*s == '.' && (s[1] == '\0' || (s[1] == '.' && s[2] == '\0')))
+			continue;
+		if ((mlist = automap(w->prefix)) != NULL) {
+			/* Not mounted yet.  Don't trigger the automounter,
+			   the rest of the path lives on this server. */
+			if (!ur_server(w, mlist)) {
+				w->state = UR_FAIL;
+				break;
+			}
+			if (vflg && w->rest[w->pos + strspn(w->rest + w->pos, "/")])
+				fprintf(stderr, "%s: %s not mounted, rest of path not checked\n",
+					w->path, w->prefix);
+			while (ur_component(w) != NULL)
+				;
+			if (w->state == UR_WALK)
+				w->state = UR_OK;
+			break;
+		}
+		if ((mlist = isnfsmnt(w->prefix)) != NULL && !ur_server(w, mlist)) {
+			w->state = UR_FAIL;
+			break;
+		}
+		alarm(0);
+		return 1;
+	}
+	alarm(0);
+	return 0;
+}
+
+static void
+ur_done(w, res)
+/*
+ * Take the result of looking up w->prefix, res is 0 or -errno, and
+ * walk on to the next component to look up, if any
+ */
+struct ur_walk *w;
+int res;
+{
+	char symlink[MAXPATHLEN], *s;
+	int i;
+
+	TRACE3(walk__step__return, w->prefix, -res, 0L);
+	if (res == -ETIME || res == -ECANCELED) {
+		fprintf(stderr, "%s: timed out\n", w->prefix);
+		w->cut |= sliced("timeout");
+		w->state = UR_FAIL;
+		return;
+	}
+	if (res < 0) {
+		errno = -res;
+		if (errno != ENOENT || !qflg)
+			perror(w->prefix);
+		w->state = UR_FAIL;
+		return;
+	}
+	if (S_ISDIR(w->stx.stx_mode)) {
+		(void) ur_step(w);
+		return;
+	}
+	if (!S_ISLNK(w->stx.stx_mode)) {
+		if (fflg)
+			w->state = UR_OK;
+		else {
+			errno = ENOTDIR;
+			perror(w->prefix);
+			w->state = UR_FAIL;
+		}
+		return;
+	}
+
+	if (++w->links > 64) {
+		fprintf(stderr, "%s: Too many levels of symbolic links\n",
+			w->path);
+		w->state = UR_FAIL;
+		return;
+	}
+	signal(SIGALRM, sigalrm);
+	path_alarm();
+	if (setjmp(alarmclock)) {
+		fprintf(stderr, "%s: timed out\n", w->prefix);
+		w->cut |= sliced("timeout");
+		w->state = UR_FAIL;
+		return;
+	}
+	i = readlink(w->prefix, symlink, MAXPATHLEN-1);
+	alarm(0);
+	if (i < 0) {
+		perror(w->prefix);
+		w->state = UR_FAIL;
+		return;
+	}
+	symlink[i] = '\0';
+	/* Remove symlink from tail of prefix, walk its target next */
+	if ((s = strrchr(w->prefix, '/')) != NULL)
+		*s = '\0';
+	if (symlink[0] == '/')
+		w->prefix[0] = '\0';
+	if (i + strlen(w->rest + w->pos) + 2 > sizeof(w->rest)) {
+		fprintf(stderr, "%s: File name too long\n", w->path);
+		w->state = UR_FAIL;
+		return;
+	}
+	strcat(symlink, "/");
+	strcat(symlink, w->rest + w->pos);
+	strcpy(w->rest, symlink);
+	w->pos = 0;
+	(void) ur_step(w);
+}
+
+static void
+ur_round(batch, n)
+/*
+ * Look up the next component of the n walks in batch, and wait for
+ * all of them to be answered or to time out
+ */
+struct ur_walk **batch;
+int n;
+{
+	struct __kernel_timespec ts;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct ur_walk *w;
+	unsigned tail = *ur.sq_tail, head, seq;
+	long ms = timeout * 1000L + 1000;
+	int i, left = n;
+
+	if (run_deadline && run_deadline - now_ms() < ms)
+		ms = run_deadline - now_ms();
+	if (ms < 1)
+		ms = 1;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	TRACE1(uring__round, n);
+	if (Dflg)
+		fprintf(stderr, "io_uring: %d lookups\n", n);
+
+	for (i = 0; i < n; i++) {
+		w = batch[i];
+		w->seq = (w->seq + 1) & 0x7fffffff;
+		w->inflight = 1;
+		TRACE1(walk__step, w->prefix);
+		sqe = ur_sqe(&tail);
+		sqe->opcode = IORING_OP_STATX;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)w->prefix;
+		sqe->len = STATX_TYPE;
+		sqe->off = (uintptr_t)&w->stx;
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+		sqe->user_data = (uint64_t)(w - ur_w) << 32 | w->seq << 1;
+		sqe = ur_sqe(&tail);
+		sqe->opcode = IORING_OP_LINK_TIMEOUT;
+		sqe->addr = (uintptr_t)&ts;
+		sqe->len = 1;
+		sqe->user_data = (uint64_t)(w - ur_w) << 32 | w->seq << 1 | 1;
+	}
+	__atomic_store_n(ur.sq_tail, tail, __ATOMIC_RELEASE);
+
+	/* the paths and timeouts are copied when submitted, the
+	   statx buffers stay ours for good in case a lookup hangs */
+	if (syscall(__NR_io_uring_enter, ur.fd, 2 * n, 0, 0, NULL, 0) < 0) {
+		perror("io_uring_enter");
+		for (i = 0; i < n; i++)
+			batch[i]->state = UR_FAIL;
+		return;
+	}
+	while (left > 0) {
+		if (syscall(__NR_io_uring_enter, ur.fd, 0, 1,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+			perror("io_uring_enter");
+			break;
+		}
+		head = *ur.cq_head;
+		while (head != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &ur.cqes[head++ & *ur.cq_mask];
+			w = &ur_w[cqe->user_data >> 32];
+			seq = (cqe->user_data >> 1) & 0x7fffffff;
+			if (!w->inflight || w->seq != seq)
+				continue;	/* answer after timeout */
+			if ((cqe->user_data & 1) && cqe->res != -ETIME)
+				continue;	/* lookup was first */
+			w->inflight = 0;
+			--left;
+			/* another round for this walk if it goes on */
+			ur_done(w, (cqe->user_data & 1) ? -ETIME : cqe->res);
+		}
+		__atomic_store_n(ur.cq_head, head, __ATOMIC_RELEASE);
+	}
+	for (i = 0; i < n; i++)
+		if (batch[i]->inflight)
+			batch[i]->state = UR_FAIL;
+}
+
+static void
+ur_add(path, pwd)
+/*
+ * Add path to the walks, relative to pwd
+ */
+char *path, *pwd;
+{
+	static int size;
+	struct ur_walk *w;
+	struct dep_entry *e;
+
+	if ((e = deps_find(path)) != NULL && deps_each(e, deps_alive) != NULL)
+		return;		/* chkpath won't even look */
+	if (inc_on && *path == '/' && inc_path(path) != NULL)
+		return;		/* nor probably at this one */
+	if (ur_n == size) {
+		size = size ? 2 * size : 64;
+		ur_w = xrealloc(ur_w, size * sizeof(*ur_w));
+	}
+	w = &ur_w[ur_n++];
+	memset(w, 0, sizeof(*w));
+	w->path = path;
+	strcpy(w->prefix, *path == '/' ? "" : pwd);
+	strncpy(w->rest, path, sizeof(w->rest) - 1);
+}
+
+static int
+ur_batch(args, nargs)
+/*
+ * Walk every path in the arguments, for chkpath to look up.  Return
+ * 0 if io_uring can't be used
+ */
+char **args;
+int nargs;
+{
+	struct ur_walk **batch;
+	char pwd[MAXPATHLEN];
+	int i, n, more;
+	long saved_slice = slice_end;
+
+	if (!ur_setup())
+		return 0;
+	if (getcwd(pwd, sizeof(pwd)-1) == NULL) {
+		perror("getcwd()");
+		return 0;
+	}
+	arg_paths(args, nargs, ur_add, pwd);
+	if (Dflg)
+		fprintf(stderr, "io_uring: walking %d paths\n", ur_n);
+
+	/* servers found on the way get the whole -d budget */
+	slice_end = run_deadline;
+	batch = xalloc(UR_BATCH * sizeof(*batch));
+	for (i = 0; i < ur_n; i++)
+		(void) ur_step(&ur_w[i]);
+	do {
+		more = 0;
+		for (i = n = 0; i < ur_n; i++) {
+			if (ur_w[i].state != UR_WALK || ur_w[i].inflight)
+				continue;
+			if (n == UR_BATCH) {
+				more = 1;
+				break;
+			}
+			batch[n++] = &ur_w[i];
+		}
+		if (n > 0)
+			ur_round(batch, n);
+		for (i = 0; i < ur_n; i++)
+			if (ur_w[i].state == UR_WALK)
+				more = 1;
+	} while (more);
+	free(batch);
+	slice_end = saved_slice;
+	return 1;
+}
+
+static int
+ur_lookup(path, ret)
+/*
+ * Find path among the walks, and set *ret, prefix and the path_*
+ * globals like _chkpath would.  Return 0 if not walked
+ */
+char *path;
+int *ret;
+{
+	struct ur_walk *w;
+	int i;
+
+	if (ur_next >= ur_n || strcmp(ur_w[ur_next].path, path) != 0) {
+		for (i = 0; i < ur_n; i++)
+			if (strcmp(ur_w[i].path, path) == 0)
+				break;
+		if (i == ur_n)
+			return 0;
+		ur_next = i;
+	}
+	w = &ur_w[ur_next++];
+	strcpy(prefix, w->prefix);
+	path_remote = w->remote;
+	path_rtt = w->rtt;
+	path_oprtt = w->oprtt;
+	slice_cut = w->cut;
+	for (i = 0; i < w->deps.n; i++)
+		deps_add(&path_deps, w->deps.m[i]);
+	*ret = w->state == UR_OK;
+	return 1;
+}
+#else
+#define ur_batch(args, nargs)	0
+#define ur_lookup(path, ret)	0
+#endif
+
+int
+chkpath(path)
+/*
+ * Check path for accessibility.  Return 1 if ok, 0 if error
+ */
+char *path;
+{
+	char pwd[MAXPATHLEN];
+	int ret;
+	long start;
+
+	if (Dflg)
+	    fprintf(stderr, "chkpath(%s)\n", path);
+
+	path_remote = 0;
+	path_rtt = path_oprtt = 0;
+	path_deps.n = 0;
+
+	/* known from the last run (-i) */
+	if (inc_lookup(path, &ret))
+		return ret;
+
+	/* a server it needed last time is dead, don't even look */
+	if (deps_dead(path)) {
+		ret = 0;
+		goto record;
+	}
+
+	/* already walked with -U */
+	if (ur_lookup(path, &ret)) {
+		if (prefix[0] == 0)
+			strcpy(prefix, "/");
+		goto done;
+	}
+
+	if (getcwd(pwd, sizeof(pwd)-1) == NULL) {
+	    perror("getcwd()");
+	    return 0;
+	}
+	if (*path != '/')   /* If not absolute path, get initial prefix */
+		strcpy(prefix, pwd);
+
+	/* Allow maximum 64 levels of symbolic links */
+	TRACE1(chkpath__entry, path);
+	start = TRACE_US();
+	ret = _chkpath(path, 64);
+	TRACE3(chkpath__return, path, ret, TRACE_US() - start);
+	
+	/* "/" becomes "", crude fix */
+	if (prefix[0] == 0)
+		strcpy(prefix, "/");
+
+	/* restore cwd so relative paths work next time around */
+	chdir(pwd);
+
+done:
+	/* the mounts above it only matter to what is kept or printed */
+	if (ret && (deps_on || Gflg))
+		ret = deps_parents(prefix);
+	deps_remember(path);
+record:
+	inc_record(path, ret);
+	return ret;
+}
+
+/* Return point after '=' for opt in comma separated list */
+const char *
+find_opt_val(list, opt)
+	const char *list, *opt;
+{
+	int optlen;
+	char *search;
+	const char *found;
+
+	optlen = strlen(opt);
+	search = xalloc(optlen + 2);
+	strcpy(search + 1, opt);
+	search[0] = ',';
+	search[optlen+1] = '=';
+	search[optlen+2] = 0;
+	/* First check for first argument */
+	if (strncmp(list, search+1, optlen+1) == 0)
+		return list + optlen + 1;
+	else if ((found = strstr(list, search)))
+		return found + optlen + 2;
+	else
+		return NULL;
+}
+
+char *
+copy_opt_val(list, opt)
+	const char *list, *opt;
+{
+	const char *start;
+	const char *comma;
+	int length;
+	char *copy;
+
+	if ((start = find_opt_val(list, opt)) == NULL)
+		return NULL;
+
+	if ((comma = strchr(start, ',')))
+		length = comma - start;
+	else
+		length = strlen(start);
+	copy = xalloc(length + 1);
+	strncpy(copy, start, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+void
+nfs_opts(mlist, fsname, opts)
+/*
+ * Pick NFS version and transport from mount options
+ */
+	struct m_mlist *mlist;
+	const char *fsname, *opts;
+{
+	const char *opt;
+
+	if ((opt = find_opt_val(opts, "vers")))
+		mlist->nfs_version = atoi(opt);
+	else if ((opt = find_opt_val(opts, "nfsvers")))
+		mlist->nfs_version = atoi(opt);
+	if (opt && Dflg)
+		fprintf(stderr, "%s: NFS version is %d\n",
+			fsname, mlist->nfs_version);
+
+	if ((opt = find_opt_val(opts, "proto"))) {
+		if (Dflg)
+			fprintf(stderr, "%s: proto is at '%s'\n",
+				fsname, opt);
+		mlist->proto = strncmp(opt, "tcp", 3) == 0 ?
+			IPPROTO_TCP : IPPROTO_UDP;
+	}
+}
+
+/*
+ * Begin machine dependent code for mount table 
+ */
+
+#if defined(sun) && defined(__SVR4)
+#include <sys/mnttab.h>
+void
+mkm_mlist()
+/*
+ * Build list of mnt entries - Solaris version
+ */
+{
+    FILE *mounted;
+    struct m_mlist *mlist;
+    struct mnttab mnt;
+    const char *file = *nsmtab ? nsmtab : mtab ? mtab : MNTTAB;
+    FILE *mounts = fopen(file, "r");
+    int i;
+
+    if (mounts == NULL) {
+	perror(file);
+	exit (1);
+    }
+
+    do {
+	i = getmntent(mounts, &mnt);
+	if (i > 0) {
+	    fprintf (stderr, "%s: getmntent returns %d\n", file, i);
+	    exit (1);
+	} 
+	if (i == -1) break;
+	mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
+	memset(mlist, 0, sizeof(*mlist));
+	mlist->mlist_next = firstmnt;
+	mlist->mlist_checked = 0;
+	mlist->mlist_dir = xalloc(strlen(mnt.mnt_mountp)+1);
+	(void) strcpy(mlist->mlist_dir, mnt.mnt_mountp);
+	mlist->mlist_fsname = xalloc(strlen(mnt.mnt_special)+1);
+        (void) strcpy(mlist->mlist_fsname, mnt.mnt_special);
+        if (strcmp(mnt.mnt_fstype, "nfs") == 0 || strcmp(mnt.mnt_fstype, "nfs4") == 0) {
+	    mlist->mlist_isnfs = 1;
+	} else {
+	    mlist->mlist_isnfs = 0;
+	}
+	firstmnt = mlist;
+    } while (1);
+    (void) fclose(mounts);
+}
+#elif defined(sun) || defined(sgi) || defined(__hpux) || defined(NeXT) || defined(linux)
+#include <mntent.h>
+static void
+mlist_add(mnt)
+/*
+ * Add one mount table entry to the list
+ */
+struct mntent *mnt;
+{
+	struct m_mlist *mlist;
+
+        mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
+        memset(mlist, 0, sizeof(struct m_mlist));
+	mlist->mlist_pid = 0;
+	mlist->nfs_version = 0;
+        mlist->nfs_version = 0;
+        mlist->mountaddr = NULL;
+	/* remember the local automounter with funny entry.  Linux only? */
+	{
+		char dummy1[MAXPATHLEN];
+		int  pid;
+
+		if (sscanf(mnt->mnt_fsname, "%[^(](pid%d)",
+			   dummy1, &pid) == 2) {
+			mlist->mlist_pid = pid;
+		}
+        }
+        if (strncmp(mnt->mnt_type, "nfs", 3) == 0)
+	{
+                const char *opt;
+
+		nfs_opts(mlist, mnt->mnt_fsname, mnt->mnt_opts);
+		if ((opt = copy_opt_val(mnt->mnt_opts, "mountaddr")) ||
+		    (opt = copy_opt_val(mnt->mnt_opts, "addr"))) {
+			if (Dflg)
+				fprintf(stderr, "%s: mountaddr is %s\n",
+					mnt->mnt_fsname, opt);
+			mlist->mlist_addr = (char *)opt;
+		}
+	}
+	mlist->mlist_next = firstmnt;
+	mlist->mlist_checked = 0;
+	mlist->mlist_dir = xalloc(strlen(mnt->mnt_dir)+1);
+	(void) strcpy(mlist->mlist_dir, mnt->mnt_dir);
+	mlist->mlist_fsname = xalloc(strlen(mnt->mnt_fsname)+1);
+	(void) strcpy(mlist->mlist_fsname, mnt->mnt_fsname);
+	mlist->mlist_isnfs = !strcmp(mnt->mnt_type, MNTTYPE_NFS) ||
+		!strcmp(mnt->mnt_type, "nfs4") ||
+		(mlist->mlist_pid && !strcmp(mnt->mnt_type, "autofs"));
+	/* a modern autofs mount, where the kernel asks the daemon
+	   to mount entries as they are looked up */
+	if (!mlist->mlist_pid && !strcmp(mnt->mnt_type, "autofs")) {
+		if (hasmntopt(mnt, "direct"))
+			mlist->mlist_autofs = AUTOFS_DIRECT;
+		else if (!hasmntopt(mnt, "offset"))
+			mlist->mlist_autofs = AUTOFS_INDIRECT;
+	}
+	firstmnt = mlist;
+}
+
+static char *
+unoctal(s)
+/*
+ * Undo the \ooo escapes of blanks and backslashes in mount tables
+ */
+char *s;
+{
+	char *from, *to;
+
+	for (from = to = s; *from; to++)
+		if (from[0] == '\\' && from[1] >= '0' && from[1] <= '3' &&
+		    from[2] >= '0' && from[2] <= '7' &&
+		    from[3] >= '0' && from[3] <= '7') {
+			*to = (from[1] - '0') << 6 | (from[2] - '0') << 3 |
+				(from[3] - '0');
+			from += 4;
+		} else
+			*to = *from++;
+	*to = '\0';
+	return s;
+}
+
+static void
+mountinfo_read(fp)
+/*
+ * Read /proc/<pid>/mountinfo format:
+ *   id parent major:minor root mountpoint opts [tags...] - type source superopts
+ * The per mount and the superblock options are joined, NFS keeps
+ * addr=, vers= and proto= in the latter.
+ */
+FILE *fp;
+{
+	char line[4 * MAXPATHLEN], opts[2 * MAXPATHLEN];
+	char *field[32], *s;
+	struct mntent mnt;
+	int n, dash;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		n = 0;
+		dash = -1;
+		for (s = strtok(line, " \n"); s != NULL && n < 32;
+		     s = strtok(NULL, " \n")) {
+			if (dash < 0 && n >= 6 && strcmp(s, "-") == 0)
+				dash = n;
+			field[n++] = s;
+		}
+		if (dash < 0 || n < dash + 3)
+			continue;
+		snprintf(opts, sizeof(opts), "%s,%s", field[5],
+			 dash + 3 < n ? field[dash + 3] : "");
+		memset(&mnt, 0, sizeof(mnt));
+		mnt.mnt_dir = unoctal(field[4]);
+		mnt.mnt_type = field[dash + 1];
+		mnt.mnt_fsname = unoctal(field[dash + 2]);
+		mnt.mnt_opts = opts;
+		mlist_add(&mnt);
+	}
+}
+
+void
+mkm_mlist()
+/*
+ * Build list of mnt entries - SunOS/IRIX/HP-UX/NeXTSTEP/Linux version.
+ * With -M, the table is read from a file, in mtab or mountinfo format.
+ */
+{
+	FILE *mounted;
+	struct mntent *mnt;
+	const char *file = *nsmtab ? nsmtab : mtab ? mtab : MOUNTED;
+	char line[BUFSIZ];
+	int id, parent, major, minor;
+
+	if ((mounted = setmntent(file, "r"))== NULL) {
+		perror(file);
+		exit(1);
+	}
+	if (fgets(line, sizeof(line), mounted) != NULL &&
+	    sscanf(line, "%d %d %d:%d", &id, &parent, &major, &minor) == 4) {
+		rewind(mounted);
+		mountinfo_read(mounted);
+		(void) endmntent(mounted);
+		return;
+	}
+	rewind(mounted);
+	while ((mnt = getmntent(mounted)) != NULL)
+		mlist_add(mnt);
+	(void) endmntent(mounted);
+}
+#elif defined(ultrix)
+#include <sys/fs_types.h>
+#include <sys/mount.h>
+void
+mkm_mlist()
+/*
+ * Build list of mnt entries - Ultrix version
+ */
+{
+	struct m_mlist *mlist;
+	struct fs_data fs_data;
+	int start=0, len;
+
+	while ((len = getmnt(&start, &fs_data, sizeof(fs_data), 
+			NOSTAT_MANY, NULL)) > 0) {
+		mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
+		memset(mlist, 0, sizeof(*mlist));
+		mlist->mlist_next = firstmnt;
+		mlist->mlist_checked = 0;
+		mlist->mlist_dir = xalloc(strlen(fs_data.fd_path)+1);
+		(void) strcpy(mlist->mlist_dir, fs_data.fd_path);
+		mlist->mlist_fsname = 
+			xalloc(strlen(fs_data.fd_devname)+1);
+		(void) strcpy(mlist->mlist_fsname, fs_data.fd_devname);
+		mlist->mlist_isnfs = (fs_data.fd_fstype == GT_NFS);
+		firstmnt = mlist;
+	}
+	if (len < 0) {
+		perror("getmnt");
+		exit(1);
+	}
+}
+#elif defined (__osf__)
+#include <sys/mount.h>
+void
+mkm_mlist()
+{
+	struct statfs *fs;
+	int i;
+	int max;
+	struct m_mlist *mlist;
+	max = getfsstat ((struct statfs *)0, 0 , MNT_NOWAIT);
+	fs = (struct statfs *) xalloc (sizeof(struct statfs)*max);
+	max = getfsstat(fs, sizeof(struct statfs)*max, MNT_NOWAIT);
+	for (i = 0; i < max; i++) {
+		mlist = (struct m_mlist *)xalloc(sizeof(struct m_mlist));
+		memset(mlist, 0, sizeof(struct m_mlist));
+		mlist->mlist_next = firstmnt;
+		mlist->mlist_checked = 0;
+		mlist->mlist_dir = xalloc (strlen (fs[i].f_mntonname) + 1);
+		(void) strcpy (mlist->mlist_dir, fs[i].f_mntonname);
+		mlist->mlist_fsname = xalloc (strlen (fs[i].f_mntfromname) + 1);
+		(void) strcpy (mlist->mlist_fsname, fs[i].f_mntfromname);
+		mlist->mlist_isnfs = (fs[i].f_type == MOUNT_NFS);
+		firstmnt = mlist;
+	}
+	free((char *)fs);
+}
+#elif defined (__NetBSD__)
+#include <sys/mount.h>
+void
+mkm_mlist()
+/*
+ * Build list of mnt entries - 4.4BSD version
+ */
+{
+	struct statvfs *fs;
+	int i, max;
+	struct m_mlist *mlist;
+
+	max = getmntinfo(&fs, ST_NOWAIT); /* use cached; do not query each file system */
+
+	for (i = 0; i < max; i++) {
+		mlist = (struct m_mlist *)xalloc(sizeof(struct m_mlist));
+		memset(mlist, 0, sizeof(struct m_mlist));
+		mlist->mlist_next = firstmnt;
+		mlist->mlist_checked = 0;
+		mlist->mlist_dir = xalloc (strlen (fs[i].f_mntonname) + 1);
+		(void) strcpy (mlist->mlist_dir, fs[i].f_mntonname);
+		mlist->mlist_fsname = xalloc (strlen (fs[i].f_mntfromname) + 1);
+		(void) strcpy (mlist->mlist_fsname, fs[i].f_mntfromname);
+		mlist->mlist_isnfs = (strcmp(fs[i].f_fstypename, "nfs") == 0);
+		firstmnt = mlist;
+	}
+}
+#else
+	UNDEFINED_mkm_mlist
+#endif
+
+
+/*
+ * Mount table snapshot (-m).  Parsing a large mount table and looking
+ * up the address of every NFS server can cost more than checking the
+ * paths, so the parsed list is written to a file that later runs map
+ * read-only and use as is.  The snapshot is keyed by a hash of the
+ * mount table (see snap_key), and rewritten when it changes:
+ *
+ *	struct snap_header
+ *	struct snap_mount mount[nmounts]	in list order
+ *	struct snap_addr addr[naddrs]		server addresses
+ *	char strings[strsize]
+ *
+ * There are only offsets and indexes in it, no pointers.
+ */
+
+#define SNAP_MAGIC	"CKNFSMT1"
+
+#if defined(MNTTAB)
+# define SNAP_MTAB	MNTTAB
+#elif defined(MOUNTED)
+# define SNAP_MTAB	MOUNTED
+#endif
+
+struct snap_header {
+	char magic[8];
+	uint64_t hash;		/* of the mount table */
+	uint32_t tabsize;	/* and its size */
+	uint32_t nmounts;
+	uint32_t naddrs;
+	uint32_t strsize;
+};
+
+struct snap_mount {
+	uint32_t dir;		/* string offsets */
+	uint32_t fsname;
+	int32_t isnfs;
+	int32_t pid;
+	int32_t autofs;
+	int32_t nfs_version;
+	int32_t proto;
+	uint32_t addr;		/* index of the first address */
+	uint32_t naddr;
+};
+
+struct snap_addr {
+	int32_t family;
+	int32_t socktype;
+	int32_t protocol;
+	uint32_t addrlen;
+	unsigned char addr[sizeof(struct sockaddr_in6)];
+};
+
+static uint64_t siphash();
+static char *snap_map;		/* the snapshot in use */
+static size_t snap_len;
+static struct m_mlist *snap_nodes; /* and the list made from it */
+
+static int
+snap_key()
+/*
+ * Hash the mount table into snap_hash and snap_tabsize.  A regular
+ * file, like /etc/mtab or one given with -M, is rewritten when it
+ * changes, so its inode, size and time are enough.  Files in /proc
+ * have no size or time, and are read and hashed.
+ * Return 0 if it cannot be read
+ */
+{
+	static const unsigned char zero[16];
+	const char *file;
+	char *buf = NULL;
+	size_t size = 0, n = 0;
+	ssize_t r;
+	struct stat stb;
+	uint64_t id[5];
+	int fd;
+
+#ifdef SNAP_MTAB
+	file = mtab ? mtab : SNAP_MTAB;
+#else
+	if ((file = mtab) == NULL)
+		return 0;
+#endif
+	if ((fd = open(file, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &stb) == 0 && S_ISREG(stb.st_mode) && stb.st_size > 0) {
+		close(fd);
+		id[0] = stb.st_dev;
+		id[1] = stb.st_ino;
+		id[2] = stb.st_size;
+		id[3] = stb.st_mtime;
+#ifdef linux
+		id[4] = stb.st_mtim.tv_nsec;
+#else
+		id[4] = stb.st_ctime;
+#endif
+		snap_hash = siphash((const unsigned char *)id, sizeof(id), zero);
+		snap_tabsize = stb.st_size;
+		return 1;
+	}
+	for (;;) {
+		if (n == size)
+			buf = xrealloc(buf, size = size ? 2 * size : 16384);
+		if ((r = read(fd, buf + n, size - n)) <= 0)
+			break;
+		n += r;
+	}
+	close(fd);
+	if (r == 0) {
+		snap_hash = siphash((const unsigned char *)buf, n, zero);
+		snap_tabsize = n;
+	}
+	free(buf);
+	return r == 0;
+}
+
+static int
+snap_load()
+/*
+ * Make the mount list from the snapshot, if it matches the mount
+ * table.  Return 0 if the table has to be parsed
+ */
+{
+	const struct snap_header *hdr;
+	const struct snap_mount *mnt;
+	const struct snap_addr *addr;
+	const char *strings;
+	struct m_mlist *mlist;
+	struct addrinfo *ai;
+	struct sockaddr_storage *sa;
+	struct stat stb;
+	char *map;
+	uint32_t i, j, k;
+	int fd;
+
+	if (!snap_key())
+		return 0;
+	if ((fd = open(snapfile, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &stb) < 0 || stb.st_size < sizeof(*hdr)) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, stb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	hdr = (const struct snap_header *)map;
+	mnt = (const struct snap_mount *)(hdr + 1);
+	addr = (const struct snap_addr *)(mnt + hdr->nmounts);
+	strings = (const char *)(addr + hdr->naddrs);
+	if (memcmp(hdr->magic, SNAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->hash != snap_hash || hdr->tabsize != snap_tabsize ||
+	    sizeof(*hdr) + (size_t)hdr->nmounts * sizeof(*mnt) +
+	    (size_t)hdr->naddrs * sizeof(*addr) + hdr->strsize != stb.st_size ||
+	    hdr->strsize == 0 || strings[hdr->strsize - 1] != '\0') {
+		if (Dflg)
+			fprintf(stderr, "%s: stale, parsing the mount table\n",
+				snapfile);
+		munmap(map, stb.st_size);
+		return 0;
+	}
+	for (i = 0; i < hdr->nmounts; i++)
+		if (mnt[i].dir >= hdr->strsize || mnt[i].fsname >= hdr->strsize ||
+		    mnt[i].addr > hdr->naddrs ||
+		    mnt[i].naddr > hdr->naddrs - mnt[i].addr) {
+			fprintf(stderr, "%s: corrupt snapshot\n", snapfile);
+			munmap(map, stb.st_size);
+			return 0;
+		}
+
+	/* one block for the nodes and their addresses, which are
+	   written to (the port), so they can't stay in the map */
+	snap_nodes = xalloc(hdr->nmounts * sizeof(*mlist) +
+			    hdr->naddrs * (sizeof(*ai) + sizeof(*sa)) + 1);
+	memset(snap_nodes, 0, hdr->nmounts * sizeof(*mlist) +
+	       hdr->naddrs * (sizeof(*ai) + sizeof(*sa)));
+	ai = (struct addrinfo *)(snap_nodes + hdr->nmounts);
+	sa = (struct sockaddr_storage *)(ai + hdr->naddrs);
+	for (i = 0; i < hdr->naddrs; i++) {
+		ai[i].ai_family = addr[i].family;
+		ai[i].ai_socktype = addr[i].socktype;
+		ai[i].ai_protocol = addr[i].protocol;
+		ai[i].ai_addrlen = addr[i].addrlen < sizeof(addr[i].addr) ?
+			addr[i].addrlen : sizeof(addr[i].addr);
+		ai[i].ai_addr = (struct sockaddr *)&sa[i];
+		memcpy(&sa[i], addr[i].addr, ai[i].ai_addrlen);
+	}
+	for (i = 0; i < hdr->nmounts; i++) {
+		mlist = &snap_nodes[i];
+		mlist->mlist_snap = 1;
+		mlist->mlist_dir = (char *)strings + mnt[i].dir;
+		mlist->mlist_fsname = (char *)strings + mnt[i].fsname;
+		mlist->mlist_isnfs = mnt[i].isnfs;
+		mlist->mlist_pid = mnt[i].pid;
+		mlist->mlist_autofs = mnt[i].autofs;
+		mlist->nfs_version = mnt[i].nfs_version;
+		mlist->proto = mnt[i].proto;
+		for (j = 0; j < mnt[i].naddr; j++) {
+			k = mnt[i].addr + j;
+			if (j + 1 < mnt[i].naddr)
+				ai[k].ai_next = &ai[k + 1];
+		}
+		if (mnt[i].naddr)
+			mlist->mountaddr = &ai[mnt[i].addr];
+		mlist->mlist_next = i + 1 < hdr->nmounts ? mlist + 1 : firstmnt;
+	}
+	if (hdr->nmounts)
+		firstmnt = snap_nodes;
+	snap_map = map;
+	snap_len = stb.st_size;
+	if (Dflg)
+		fprintf(stderr, "%s: %u mounts from snapshot\n",
+			snapfile, hdr->nmounts);
+	return 1;
+}
+
+static void
+snap_write()
+/*
+ * Write the freshly parsed mount list to the snapshot, unless the
+ * mount table changed while it was read
+ */
+{
+	struct snap_header hdr;
+	struct snap_mount *mnt;
+	struct snap_addr *addr;
+	struct m_mlist *mlist;
+	struct addrinfo *rp;
+	uint64_t hash = snap_hash;
+	uint32_t tabsize = snap_tabsize;
+	char tmp[MAXPATHLEN + 16];
+	char *strings;
+	uint32_t n, na, nstr;
+	FILE *fp;
+
+	if (!snap_key() || snap_hash != hash || snap_tabsize != tabsize)
+		return;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+	hdr.hash = hash;
+	hdr.tabsize = tabsize;
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		hdr.nmounts++;
+		/* pay for the lookups once, not on every mapped run */
+		if (!mlist->mountaddr && mlist->mlist_addr)
+			translate_address(mlist->mlist_addr, mlist->proto,
+					  &mlist->mountaddr);
+		for (rp = mlist->mountaddr; rp != NULL; rp = rp->ai_next)
+			if (rp->ai_addrlen <= sizeof(addr->addr))
+				hdr.naddrs++;
+		hdr.strsize += strlen(mlist->mlist_dir) +
+			strlen(mlist->mlist_fsname) + 2;
+	}
+	mnt = xalloc(hdr.nmounts * sizeof(*mnt) + 1);
+	addr = xalloc(hdr.naddrs * sizeof(*addr) + 1);
+	strings = xalloc(hdr.strsize + 1);
+	memset(addr, 0, hdr.naddrs * sizeof(*addr));
+	n = na = nstr = 0;
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next, n++) {
+		mnt[n].dir = nstr;
+		strcpy(strings + nstr, mlist->mlist_dir);
+		nstr += strlen(mlist->mlist_dir) + 1;
+		mnt[n].fsname = nstr;
+		strcpy(strings + nstr, mlist->mlist_fsname);
+		nstr += strlen(mlist->mlist_fsname) + 1;
+		mnt[n].isnfs = mlist->mlist_isnfs;
+		mnt[n].pid = mlist->mlist_pid;
+		mnt[n].autofs = mlist->mlist_autofs;
+		mnt[n].nfs_version = mlist->nfs_version;
+		mnt[n].proto = mlist->proto;
+		mnt[n].addr = na;
+		for (rp = mlist->mountaddr; rp != NULL; rp = rp->ai_next) {
+			if (rp->ai_addrlen > sizeof(addr->addr))
+				continue;
+			addr[na].family = rp->ai_family;
+			addr[na].socktype = rp->ai_socktype;
+			addr[na].protocol = rp->ai_protocol;
+			addr[na].addrlen = rp->ai_addrlen;
+			memcpy(addr[na++].addr, rp->ai_addr, rp->ai_addrlen);
+		}
+		mnt[n].naddr = na - mnt[n].addr;
+	}
+
+	if ((fp = tmp_create(snapfile, tmp, sizeof(tmp))) != NULL) {
+		fwrite(&hdr, sizeof(hdr), 1, fp);
+		fwrite(mnt, sizeof(*mnt), hdr.nmounts, fp);
+		fwrite(addr, sizeof(*addr), hdr.naddrs, fp);
+		fwrite(strings, 1, hdr.strsize, fp);
+		if (fclose(fp) != 0 || rename(tmp, snapfile) != 0) {
+			perror(snapfile);
+			(void) unlink(tmp);
+		} else if (Dflg)
+			fprintf(stderr, "%s: wrote %u mounts\n",
+				snapfile, hdr.nmounts);
+	}
+	free(mnt);
+	free(addr);
+	free(strings);
+}
+
+static void
+snap_unmap()
+/*
+ * Let go of the snapshot, once the list made from it is gone
+ */
+{
+	if (snap_map != NULL) {
+		munmap(snap_map, snap_len);
+		free(snap_nodes);
+		snap_map = NULL;
+		snap_nodes = NULL;
+	}
+}
+
+
+/*
+ * Watch mode: keep probing every NFS server in the mount table and
+ * report state transitions.  Clients are kept between rounds, so a
+ * healthy server only costs one NULLPROC per interval.  Each due
+ * server is probed in a thread of its own, up to W_WORKERS at once,
+ * so a dead one waiting out its timeout doesn't hold up the others'
+ * schedule.  The errors of a server already down are not printed
+ * again every round: it was reported when it went down.
+ */
+
+#ifdef NO_PER_THREAD
+# define W_WORKERS	1	/* they would share probe_fail */
+#else
+# define W_WORKERS	64
+#endif
+
+#ifdef linux
+#include <sys/timerfd.h>
+#endif
+
+struct w_server {
+	struct w_server *ws_next;
+	char *ws_host;
+	struct m_mlist *ws_mount;	/* first mount seen from this server */
+	CLIENT *ws_client;		/* kept open between probes */
+	int ws_state;			/* W_* below */
+	const char *ws_fail;		/* probe_fail, when W_DOWN */
+	long ws_rtt;			/* last round trip in ms */
+	long ws_due;			/* next probe, ms on the monotonic clock */
+	long long ws_since;		/* state entered, ms since the epoch */
+	long long ws_okat;		/* start of our last good probe, same */
+	int ws_busy;			/* a probe thread has it */
+	int ws_quiet;			/* and keeps its errors to itself */
+};
+
+#define W_UNKNOWN	0
+#define W_UP		1
+#define W_SLOW		2
+#define W_DOWN		3
+#define W_STALLED	4	/* answers NULL, but not real operations */
+#define W_UNCHECKED	5	/* answers NULL, -R could not try an operation */
+
+static const char *w_statename[] = { "unknown", "up", "slow", "down", "stalled",
+				     "unchecked" };
+
+static struct w_server *
+w_servers()
+/*
+ * Build list of distinct NFS servers from the mount table
+ */
+{
+	struct m_mlist *mlist;
+	struct w_server *first = NULL, *ws;
+	char host[MAXPATHLEN];
+
+	mlist_read();
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		if (!mlist->mlist_isnfs || mlist->mlist_pid)
+			continue;
+		server_name(mlist->mlist_fsname, host, sizeof(host));
+		for (ws = first; ws != NULL; ws = ws->ws_next)
+			if (strcmp(ws->ws_host, host) == 0)
+				break;
+		if (ws != NULL)
+			continue;
+		ws = (struct w_server *)xalloc(sizeof(*ws));
+		memset(ws, 0, sizeof(*ws));
+		ws->ws_host = xalloc(strlen(host) + 1);
+		strcpy(ws->ws_host, host);
+		ws->ws_mount = mlist;
+		ws->ws_next = first;
+		first = ws;
+	}
+	return first;
+}
+
+static int
+w_probe(ws)
+/*
+ * Ping one server, (re)connecting if needed.  Return new W_* state.
+ */
+struct w_server *ws;
+{
+	struct m_mlist *mlist = ws->ws_mount;
+
+	probe_fail = ws->ws_fail = NULL;
+	if (ws->ws_client == NULL) {
+		if (!rpc_load()) {
+			ws->ws_fail = "no RPC library";
+			return W_DOWN;
+		}
+		if (!mount_addr(ws->ws_host, mlist)) {
+			ws->ws_fail = "unknown host";
+			return W_DOWN;
+		}
+		if (mlist->proto)
+			ws->ws_client = nfs_client(ws->ws_host, mlist->proto, mlist);
+		else if ((ws->ws_client = nfs_client(ws->ws_host, IPPROTO_TCP, mlist)) == NULL)
+			ws->ws_client = nfs_client(ws->ws_host, IPPROTO_UDP, mlist);
+		if (ws->ws_client == NULL) {
+			ws->ws_fail = probe_fail;
+			return W_DOWN;
+		}
+	}
+	if (!nfs_ping(ws->ws_client, ws->ws_host, &ws->ws_rtt)) {
+		ws->ws_fail = probe_fail;
+		clnt_destroy(ws->ws_client);
+		ws->ws_client = NULL;
+		return W_DOWN;
+	}
+	if (Rflg) {
+		switch (nfs_op(ws->ws_client, ws->ws_host, mlist)) {
+		case 0:
+			return W_STALLED;
+		case 2:
+			return W_UNCHECKED;
+		}
+		if (mlist->mlist_oprtt > ws->ws_rtt)
+			ws->ws_rtt = mlist->mlist_oprtt;
+	}
+	/* slow means above -l, or else half the time we are prepared
+	   to wait */
+	if (maxrtt)
+		return ws->ws_rtt > maxrtt ? W_SLOW : W_UP;
+	return ws->ws_rtt * 2 > timeout * 1000L ? W_SLOW : W_UP;
+}
+
+static void
+w_report(ws, state)
+struct w_server *ws;
+int state;
+{
+	char stamp[32];
+	time_t t = time(NULL);
+
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+	if (state == W_DOWN && ws->ws_fail)
+		printf("%s %s %s (%s)\n", stamp, ws->ws_host, w_statename[state],
+		       ws->ws_fail);
+	else if (state == W_DOWN || state == W_STALLED)
+		printf("%s %s %s\n", stamp, ws->ws_host, w_statename[state]);
+	else
+		printf("%s %s %s %ldms\n", stamp, ws->ws_host,
+		       w_statename[state], ws->ws_rtt);
+	fflush(stdout);
+}
+
+static long
+w_jitter(interval)
+/*
+ * Spread probes by +-10% so servers don't all get pinged in lock step
+ */
+long interval;
+{
+	long spread = interval / 5;
+
+	if (spread == 0)
+		return interval;
+	return interval - spread / 2 + (long)(rand() % spread);
+}
+
+static int w_wake[2] = { -1, -1 };	/* probe threads say they are done */
+
+static void
+w_sleep_until(tfd, due)
+/*
+ * Wait until due, or with due -1 indefinitely, or until a probe
+ * thread finishes
+ */
+int tfd;
+long due;
+{
+	struct pollfd pfd[2];
+	long delta = due - now_ms();
+	char buf[64];
+	int n = 0;
+
+	if (due >= 0 && delta <= 0)
+		return;
+	memset(pfd, 0, sizeof(pfd));
+	if (w_wake[0] >= 0) {
+		pfd[n].fd = w_wake[0];
+		pfd[n++].events = POLLIN;
+	}
+#ifdef linux
+	if (tfd >= 0 && due >= 0) {
+		struct itimerspec its;
+
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = due / 1000;
+		its.it_value.tv_nsec = (due % 1000) * 1000000L;
+		if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+			pfd[n].fd = tfd;
+			pfd[n++].events = POLLIN;
+			delta = -1;
+		}
+	}
+#endif
+	if (due < 0)
+		delta = -1;
+	if (n == 0 && delta < 0)
+		delta = 1000;	/* no way to be woken, look again soon */
+	while (poll(pfd, n, (int)delta) < 0 && errno == EINTR)
+		;
+	/* empty the pipe, and the timer if it went off */
+	while (w_wake[0] >= 0 && read(w_wake[0], buf, sizeof(buf)) > 0)
+		;
+#ifdef linux
+	if (tfd >= 0 && n > 0 && pfd[n - 1].fd == tfd && pfd[n - 1].revents)
+		(void) read(tfd, buf, sizeof(unsigned long long));
+#endif
+}
+
+/*
+ * Gossip (-g, in watch mode).  Watchers on a subnet tell each other
+ * what they find, so one node's timeout marks a server dead on all of
+ * them, and with -S makes their logins skip it, while their own
+ * probes are still waiting for an answer.  Only "down" and "stalled"
+ * are taken from peers; a server is only ever found up by probing it.
+ *
+ * A report is one UDP datagram to every -g destination, sent when one
+ * of our servers changes state and otherwise once per interval, but
+ * never more than GOSSIP_RATE a second:
+ *
+ *	"CKG1" sender(4) time(8, ms since the epoch) count(1)
+ *	count * { state(1) rtt(2, ms) since(4, ms ago) len(1) host(len) }
+ *	mac(8)
+ *
+ * The mac is SipHash-2-4 of the rest under a key derived from the -K
+ * file.  Reports older than GOSSIP_MAXAGE, from too far in the future,
+ * or not newer than the last one from the same sender are dropped, as
+ * is a claim about a server that predates our own last good probe.
+ */
+
+#define GOSSIP_MTU	1200
+#define GOSSIP_RATE	4	/* datagrams a second at most */
+#define GOSSIP_MAXAGE	30000	/* ms */
+#define GOSSIP_SKEW	5000	/* ms a sender's clock may be ahead */
+#define GOSSIP_PEERS	1024
+#define GOSSIP_DESTS	64
+
+static int g_sock = -1;
+static struct sockaddr_in g_dest[GOSSIP_DESTS];
+static int g_ndest;
+static unsigned char g_key[16];
+static u_int32_t g_id;
+static struct g_peer {
+	u_int32_t id;
+	long long last;		/* time of its newest report */
+} g_peers[GOSSIP_PEERS];
+static int g_npeers;
+static struct w_server *w_first;
+static pthread_mutex_t w_lock = PTHREAD_MUTEX_INITIALIZER;
+static int w_changed;		/* a state changed since the last g_send */
+
+#define ROTL(x, b)	(uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND	do {						\
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;			\
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;			\
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+	} while (0)
+
+static uint64_t
+le64(p)
+	const unsigned char *p;
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static uint64_t
+siphash(in, len, key)
+/*
+ * SipHash-2-4 of in[0..len-1] under the 16 byte key
+ */
+	const unsigned char *in;
+	size_t len;
+	const unsigned char *key;
+{
+	uint64_t k0 = le64(key), k1 = le64(key + 8);
+	uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+	uint64_t v3 = 0x7465646279746573ULL ^ k1;
+	uint64_t m, b = (uint64_t)len << 56;
+	const unsigned char *end = in + len - len % 8;
+	int i;
+
+	for (; in != end; in += 8) {
+		m = le64(in);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+	for (i = len % 8; i > 0; i--)
+		b |= (uint64_t)in[i - 1] << (8 * (i - 1));
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static int
+g_addr(s, sin)
+/*
+ * Parse [a.b.c.d:]port.  Return 1 if ok
+ */
+	char *s;
+	struct sockaddr_in *sin;
+{
+	char *colon = strrchr(s, ':');
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_ANY);
+	if (colon) {
+		*colon = '\0';
+		if (inet_aton(s, &sin->sin_addr) == 0)
+			return 0;
+		s = colon + 1;
+	}
+	sin->sin_port = htons(atoi(s));
+	return sin->sin_port != 0;
+}
+
+static void
+g_setup(spec)
+/*
+ * Bind the listening address, the first in spec, note the
+ * destinations and load the key.  Exit on error
+ */
+	char *spec;
+{
+	struct sockaddr_in sin;
+	unsigned char buf[4096], zero[16];
+	char *s;
+	int fd, n, on = 1;
+
+	if (keyfile == NULL) {
+		fprintf(stderr, "-g needs a key, give it with -K\n");
+		exit(1);
+	}
+	if ((fd = open(keyfile, O_RDONLY)) < 0 ||
+	    (n = read(fd, buf, sizeof(buf))) < 0) {
+		perror(keyfile);
+		exit(1);
+	}
+	close(fd);
+	if (n < 16) {
+		fprintf(stderr, "%s: key must be at least 16 bytes\n", keyfile);
+		exit(1);
+	}
+	memset(zero, 0, sizeof(zero));
+	for (fd = 0; fd < 2; fd++) {
+		uint64_t h;
+
+		zero[0] = fd;
+		h = siphash(buf, n, zero);
+		memcpy(g_key + 8 * fd, &h, 8);
+	}
+
+	if ((s = strtok(spec, ",")) == NULL || !g_addr(s, &sin)) {
+		fprintf(stderr, "-g: bad listen address\n");
+		exit(1);
+	}
+	g_sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	setsockopt(g_sock, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
+	setsockopt(g_sock, SOL_SOCKET, SO_BROADCAST, (char *)&on, sizeof(on));
+	if (bind(g_sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("gossip bind");
+		exit(1);
+	}
+	while ((s = strtok(NULL, ",")) != NULL && g_ndest < GOSSIP_DESTS)
+		if (!g_addr(s, &g_dest[g_ndest++])) {
+			fprintf(stderr, "-g: bad destination %s\n", s);
+			exit(1);
+		}
+	g_id = getpid() ^ (u_int32_t)wall_ms() ^ (u_int32_t)now_us() << 12;
+}
+
+static void
+g_send(first, changed)
+/*
+ * Tell the others what we know, if something changed or an interval
+ * has passed, and the rate allows
+ */
+	struct w_server *first;
+	int changed;
+{
+	static long credit = 1000, last, due;
+	unsigned char buf[GOSSIP_MTU];
+	struct w_server *ws;
+	long long t = wall_ms();
+	uint64_t mac;
+	u_int32_t v;
+	int i, n, len, count = 0, pass;
+
+	credit += now_ms() - last;
+	last = now_ms();
+	if (credit > 1000)
+		credit = 1000;
+	if ((!changed && last < due) || credit < 1000 / GOSSIP_RATE)
+		return;
+	credit -= 1000 / GOSSIP_RATE;
+	due = last + interval * 1000L;
+
+	memcpy(buf, "CKG1", 4);
+	v = htonl(g_id);
+	memcpy(buf + 4, &v, 4);
+	v = htonl((u_int32_t)(t >> 32));
+	memcpy(buf + 8, &v, 4);
+	v = htonl((u_int32_t)t);
+	memcpy(buf + 12, &v, 4);
+	n = 17;
+	pthread_mutex_lock(&w_lock);
+	/* the bad news first, in case not everything fits */
+	for (pass = 0; pass < 2; pass++)
+		for (ws = first; ws != NULL; ws = ws->ws_next) {
+			if (ws->ws_state == W_UNKNOWN ||
+			    (ws->ws_state == W_DOWN || ws->ws_state == W_STALLED) != !pass)
+				continue;
+			len = strlen(ws->ws_host);
+			if (len > 255 || n + 8 + len + 8 > sizeof(buf) || count == 255)
+				continue;
+			buf[n] = ws->ws_state;
+			buf[n + 1] = (ws->ws_rtt > 65535 ? 65535 : ws->ws_rtt) >> 8;
+			buf[n + 2] = (ws->ws_rtt > 65535 ? 65535 : ws->ws_rtt);
+			v = htonl((u_int32_t)(t - ws->ws_since));
+			memcpy(buf + n + 3, &v, 4);
+			buf[n + 7] = len;
+			memcpy(buf + n + 8, ws->ws_host, len);
+			n += 8 + len;
+			count++;
+		}
+	pthread_mutex_unlock(&w_lock);
+	buf[16] = count;
+	mac = siphash(buf, n, g_key);
+	for (i = 0; i < 8; i++)
+		buf[n++] = mac >> (8 * i);
+	for (i = 0; i < g_ndest; i++)
+		if (sendto(g_sock, buf, n, 0, (struct sockaddr *)&g_dest[i],
+			   sizeof(g_dest[i])) < 0 && Dflg)
+			perror("gossip sendto");
+	if (Dflg)
+		fprintf(stderr, "gossip: sent %d servers, %d bytes\n", count, n);
+}
+
+static void
+g_receive(buf, n, from)
+/*
+ * Check a report and take the bad news in it
+ */
+	unsigned char *buf;
+	int n;
+	struct sockaddr_in *from;
+{
+	struct w_server *ws;
+	struct g_peer *peer;
+	long long t, now = wall_ms(), since;
+	u_int32_t id, v;
+	uint64_t mac;
+	int i, len, count, state;
+	char host[256], stamp[32];
+	time_t tt;
+
+	if (n < 25 || memcmp(buf, "CKG1", 4) != 0)
+		return;
+	n -= 8;
+	mac = siphash(buf, n, g_key);
+	for (i = 0; i < 8; i++)
+		if (buf[n + i] != (unsigned char)(mac >> (8 * i))) {
+			if (vflg)
+				fprintf(stderr, "gossip: bad signature from %s\n",
+					inet_ntoa(from->sin_addr));
+			return;
+		}
+	memcpy(&v, buf + 4, 4);
+	if ((id = ntohl(v)) == g_id)
+		return;
+	memcpy(&v, buf + 8, 4);
+	t = (long long)ntohl(v) << 32;
+	memcpy(&v, buf + 12, 4);
+	t |= ntohl(v);
+	if (t < now - GOSSIP_MAXAGE || t > now + GOSSIP_SKEW) {
+		if (vflg)
+			fprintf(stderr, "gossip: stale report from %s\n",
+				inet_ntoa(from->sin_addr));
+		return;
+	}
+	for (i = 0; i < g_npeers; i++)
+		if (g_peers[i].id == id)
+			break;
+	if (i == g_npeers) {
+		if (g_npeers < GOSSIP_PEERS)
+			g_npeers++;
+		else	/* forget somebody */
+			i = id % GOSSIP_PEERS;
+		g_peers[i].id = id;
+		g_peers[i].last = 0;
+	}
+	peer = &g_peers[i];
+	if (t <= peer->last)
+		return;		/* replayed or reordered */
+	peer->last = t;
+
+	count = buf[16];
+	for (i = 17; count-- > 0 && i + 8 <= n; i += 8 + len) {
+		state = buf[i];
+		len = buf[i + 7];
+		if (i + 8 + len > n)
+			break;
+		if (state != W_DOWN && state != W_STALLED)
+			continue;
+		memcpy(&v, buf + i + 3, 4);
+		since = t - ntohl(v);
+		memcpy(host, buf + i + 8, len);
+		host[len] = '\0';
+
+		pthread_mutex_lock(&w_lock);
+		for (ws = w_first; ws != NULL; ws = ws->ws_next)
+			if (strcmp(ws->ws_host, host) == 0)
+				break;
+		if (ws != NULL && ws->ws_state != W_DOWN &&
+		    ws->ws_state != W_STALLED && since > ws->ws_okat) {
+			ws->ws_state = state;
+			ws->ws_since = since;
+			tt = time(NULL);
+			strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S",
+				 localtime(&tt));
+			printf("%s %s %s (peer %s)\n", stamp, host,
+			       w_statename[state], inet_ntoa(from->sin_addr));
+			fflush(stdout);
+			if (statedir && state == W_DOWN)
+				breaker_record(host, 0);
+		}
+		pthread_mutex_unlock(&w_lock);
+	}
+}
+
+static void *
+g_listen(arg)
+	void *arg;
+{
+	unsigned char buf[GOSSIP_MTU + 64];
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	int n;
+
+	for (;;) {
+		fromlen = sizeof(from);
+		n = recvfrom(g_sock, buf, sizeof(buf), 0,
+			     (struct sockaddr *)&from, &fromlen);
+		if (n < 0) {
+			if (errno != EINTR) {
+				perror("gossip recvfrom");
+				sleep(1);
+			}
+			continue;
+		}
+		g_receive(buf, n, &from);
+	}
+	return NULL;
+}
+
+static void
+w_done(ws, state, start, ivl)
+/*
+ * Take in the outcome of a probe of ws begun at start, and schedule
+ * the next one
+ */
+struct w_server *ws;
+int state;
+long long start;
+long ivl;
+{
+	pthread_mutex_lock(&w_lock);
+	if (state != ws->ws_state) {
+		w_report(ws, state);
+		ws->ws_since = wall_ms();
+		w_changed = 1;
+	}
+	/* keep the breaker open for logins while the server is down,
+	   and close it once we see it answer, whatever a peer said
+	   before */
+	if (statedir && (state == W_DOWN || ws->ws_state == W_DOWN ||
+			 ws->ws_state == W_STALLED))
+		breaker_record(ws->ws_host, state != W_DOWN);
+	ws->ws_state = state;
+	if (state == W_UP || state == W_SLOW || state == W_UNCHECKED)
+		ws->ws_okat = start;
+	ws->ws_due = now_ms() + w_jitter(ivl);
+	ws->ws_busy = 0;
+	pthread_mutex_unlock(&w_lock);
+}
+
+static void *
+w_worker(arg)
+/*
+ * Probe thread, for one server
+ */
+void *arg;
+{
+	struct w_server *ws = arg;
+	long long start = wall_ms();
+
+	probe_quiet = ws->ws_quiet;
+	w_done(ws, w_probe(ws), start, interval * 1000L);
+	if (w_wake[1] >= 0)
+		(void) write(w_wake[1], "", 1);
+	return NULL;
+}
+
+void
+watch(interval)
+/*
+ * Never returns.  interval is in seconds.
+ */
+int interval;
+{
+	struct w_server *first, *ws, *next;
+	long ivl = interval * 1000L;
+	int tfd = -1, busy, changed;
+	pthread_t tid;
+
+	if ((first = w_servers()) == NULL) {
+		fprintf(stderr, "no NFS servers in mount table\n");
+		exit(1);
+	}
+	srand(getpid() ^ time(NULL));
+	for (ws = first; ws != NULL; ws = ws->ws_next)
+		ws->ws_due = now_ms() + rand() % (ivl > 0 ? ivl : 1);
+#ifdef linux
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0 && Dflg)
+		perror("timerfd_create");
+#endif
+	if (pipe(w_wake) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	fcntl(w_wake[0], F_SETFL, fcntl(w_wake[0], F_GETFL) | O_NONBLOCK);
+	fcntl(w_wake[1], F_SETFL, fcntl(w_wake[1], F_GETFL) | O_NONBLOCK);
+	w_first = first;
+	if (gossip) {
+		g_setup(gossip);
+		if (pthread_create(&tid, NULL, g_listen, NULL) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+		pthread_detach(tid);
+	}
+	for (;;) {
+		pthread_mutex_lock(&w_lock);
+		next = NULL;
+		busy = 0;
+		for (ws = first; ws != NULL; ws = ws->ws_next)
+			if (ws->ws_busy)
+				busy++;
+			else if (next == NULL || ws->ws_due < next->ws_due)
+				next = ws;
+		pthread_mutex_unlock(&w_lock);
+		w_sleep_until(tfd, next && busy < W_WORKERS ? next->ws_due : -1L);
+
+		pthread_mutex_lock(&w_lock);
+		for (ws = first; ws != NULL && busy < W_WORKERS; ws = ws->ws_next) {
+			if (ws->ws_busy || ws->ws_due > now_ms())
+				continue;
+			if (Dflg)
+				fprintf(stderr, "watch: probing %s\n", ws->ws_host);
+			ws->ws_busy = 1;
+			/* why it went down was said when it did */
+			ws->ws_quiet = !Dflg && (ws->ws_state == W_DOWN ||
+						 ws->ws_state == W_STALLED);
+			if (pthread_create(&tid, NULL, w_worker, ws) == 0) {
+				pthread_detach(tid);
+				busy++;
+			} else {
+				/* do it ourselves then */
+				pthread_mutex_unlock(&w_lock);
+				(void) w_worker(ws);
+				pthread_mutex_lock(&w_lock);
+			}
+		}
+		changed = w_changed;
+		w_changed = 0;
+		pthread_mutex_unlock(&w_lock);
+		if (gossip)
+			g_send(first, changed);
+	}
+}
+
+/*
+ * Sweep mode (-F).  Probe every NFS server in the mount table once,
+ * with the portmapper and NULL calls of chknfsmntproto, and print one
+ * line per server as its probe completes.  Meant for a monitoring host
+ * checking a whole fleet, so the mount table is typically a list of
+ * all exports in fstab format given with -M.  The servers are dealt
+ * out to one event loop per CPU (-j), each thread polling up to
+ * SW_INFLIGHT non-blocking probes at a time.  The RPC messages are
+ * encoded by hand, as the library's clients block.
+ */
+
+#define SW_INFLIGHT	128	/* probes in progress per loop */
+
+struct sw_target {
+	char *host;
+	struct m_mlist *mount;
+	int vers, proto;	/* proto 0 from the mount: TCP, then UDP */
+	int tcp;		/* transport of this attempt */
+	int stream;		/* the socket is TCP, the portmapper's always */
+	int step;		/* SW_* below */
+	int fd, events;		/* socket and what poll waits for */
+	int connecting;
+	u_int32_t xid;
+	long deadline, resend;	/* ms, give up on this step, UDP resend */
+	long sent;		/* ms, the NULL call (first copy) went out */
+	int sched;		/* index into udp_sched */
+	char out[132];		/* call, after the TCP record mark */
+	u_int outlen;
+	char in[516];		/* reply */
+	u_int inlen;
+	long rtt;
+	const char *fail;
+	int resolved;		/* mount_addr() found its address */
+};
+
+#define SW_PMAP		1	/* asking the portmapper for the NFS port */
+#define SW_NFS		2	/* NULL call to NFS */
+#define SW_DONE		3
+
+struct sw_loop {
+	struct sw_target **t;	/* this loop's share of the servers */
+	int n;
+	size_t inflight;
+	int cpu;		/* to run on, -1 if not pinned */
+};
+
+static pthread_mutex_t sw_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sw_down;
+static int sweep_loops;	/* -j, 0 for one per CPU */
+
+static void sw_start();
+
+static struct sw_target *
+sw_targets(np)
+/*
+ * The distinct NFS servers in the mount table, by name, version and
+ * transport, in mount table order
+ */
+int *np;
+{
+	struct m_mlist *mlist;
+	struct sw_target *t, **tt = NULL;
+	char host[MAXPATHLEN];
+	int i, n = 0, size = 0, vers;
+
+	mlist_read();
+	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
+		if (!mlist->mlist_isnfs || mlist->mlist_pid)
+			continue;
+		server_name(mlist->mlist_fsname, host, sizeof(host));
+		vers = mlist->nfs_version >= 2 ? mlist->nfs_version : nfs_version;
+		for (i = 0; i < n; i++)
+			if (tt[i]->vers == vers && tt[i]->proto == mlist->proto &&
+			    strcmp(tt[i]->host, host) == 0)
+				break;
+		if (i < n) {
+			/* the list is backwards, keep the first line's mount */
+			tt[i]->mount = mlist;
+			continue;
+		}
+		if (n == size) {
+			size = size ? 2 * size : 64;
+			tt = xrealloc(tt, size * sizeof(*tt));
+		}
+		t = tt[n++] = xalloc(sizeof(*t));
+		memset(t, 0, sizeof(*t));
+		t->host = xalloc(strlen(host) + 1);
+		strcpy(t->host, host);
+		t->mount = mlist;
+		t->vers = vers;
+		t->proto = mlist->proto;
+		t->fd = -1;
+	}
+	t = xalloc((n ? n : 1) * sizeof(*t));
+	for (i = 0; i < n; i++) {
+		t[i] = *tt[n - 1 - i];
+		free(tt[n - 1 - i]);
+	}
+	free(tt);
+	*np = n;
+	return t;
+}
+
+static void
+sw_done(t, fail)
+/*
+ * Finish the probe of t, failed if fail is set, and print the outcome
+ */
+struct sw_target *t;
+const char *fail;
+{
+	if (t->fd >= 0)
+		close(t->fd);
+	t->fd = -1;
+	if (fail && t->proto == 0 && t->tcp && t->mount->mountaddr) {
+		/* as _probe_server, try UDP when the mount doesn't say */
+		t->tcp = 0;
+		sw_start(t);
+		return;
+	}
+	t->step = SW_DONE;
+	t->fail = fail;
+	pthread_mutex_lock(&sw_lock);
+	if (fail) {
+		sw_down++;
+		printf("%s v%d %s down (%s)\n", t->host, t->vers,
+		       t->tcp ? "tcp" : "udp", fail);
+	} else
+		printf("%s v%d %s up %ldms\n", t->host, t->vers,
+		       t->tcp ? "tcp" : "udp", t->rtt);
+	fflush(stdout);
+	pthread_mutex_unlock(&sw_lock);
+}
+
+static void
+sw_send(t)
+/*
+ * Send the call in t->out
+ */
+struct sw_target *t;
+{
+	u_int32_t mark = htonl(0x80000000 | t->outlen);
+	char *p = t->out + 4;
+	int len = t->outlen, err = 0;
+
+	if (t->stream) {
+		/* one fragment, with the record mark in front */
+		memcpy(t->out, &mark, 4);
+		p -= 4;
+		len += 4;
+	}
+	if (send(t->fd, p, len, MSG_NOSIGNAL) != len) {
+		err = errno;
+		sw_done(t, sock_fail(t->fd, &err));
+		return;
+	}
+	t->events = POLLIN;
+	t->inlen = 0;
+	if (t->step == SW_NFS && (t->stream || t->sched == 0))
+		t->sent = now_ms();
+	if (!t->stream) {
+		t->resend = now_ms() + udp_sched[t->sched];
+		if (t->sched < udp_nsched - 1)
+			t->sched++;
+	}
+}
+
+static void
+sw_call(t, step, port)
+/*
+ * Connect to port and send the call for step: GETPORT to the
+ * portmapper, always over TCP as nfs_client does, or the NULL call
+ */
+struct sw_target *t;
+int step, port;
+{
+	struct addrinfo *ai = t->mount->mountaddr;
+	struct sockaddr_storage sa;
+	struct pmap pmap;
+	int tcp = step == SW_PMAP || t->tcp;
+	int err;
+
+	t->step = step;
+	t->stream = tcp;
+	t->deadline = now_ms() + probe_ms();
+	t->xid = (u_int32_t)(now_us() ^ (long)t ^ step);
+	if (step == SW_PMAP) {
+		pmap.pm_prog = NFS_PROGRAM;
+		pmap.pm_vers = t->vers;
+		pmap.pm_prot = t->tcp ? IPPROTO_TCP : IPPROTO_UDP;
+		pmap.pm_port = 0;
+		t->outlen = rpc_encode(t->out + 4, sizeof(t->out) - 4, t->xid,
+				       PMAPPROG, PMAPVERS, PMAPPROC_GETPORT,
+				       (xdrproc_t)xdr_pmap, &pmap);
+	} else {
+		t->outlen = rpc_encode(t->out + 4, sizeof(t->out) - 4, t->xid,
+				       NFS_PROGRAM, t->vers, NULLPROC,
+				       (xdrproc_t)xdr_void, NULL);
+		t->sched = 0;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	memcpy(&sa, ai->ai_addr, ai->ai_addrlen);
+	((struct sockaddr_in *)&sa)->sin_port = htons(port);
+	if ((t->fd = socket(ai->ai_family, tcp ? SOCK_STREAM : SOCK_DGRAM,
+			    tcp ? IPPROTO_TCP : IPPROTO_UDP)) < 0) {
+		perror("socket");
+		sw_done(t, "error");
+		return;
+	}
+	fcntl(t->fd, F_SETFL, fcntl(t->fd, F_GETFL) | O_NONBLOCK);
+	fail_fast(t->fd, ai->ai_family, tcp ? IPPROTO_TCP : IPPROTO_UDP);
+	if (connect(t->fd, (struct sockaddr *)&sa, ai->ai_addrlen) < 0 &&
+	    errno != EINPROGRESS) {
+		err = errno;
+		sw_done(t, sock_fail(t->fd, &err));
+		return;
+	}
+	if (tcp) {
+		t->connecting = 1;
+		t->events = POLLOUT;
+	} else
+		sw_send(t);
+}
+
+static void
+sw_start(t)
+/*
+ * Start (again) probing t
+ */
+struct sw_target *t;
+{
+	if (t->step == 0)
+		t->tcp = t->proto != IPPROTO_UDP;
+	if (!t->resolved) {
+		sw_done(t, "unknown host");
+		return;
+	}
+	if (t->vers < 4)
+		sw_call(t, SW_PMAP, PMAPPORT);
+	else
+		sw_call(t, SW_NFS, 2049);
+}
+
+static void
+sw_reply(t)
+/*
+ * Act on the reply in t->in
+ */
+struct sw_target *t;
+{
+	char *p = t->in + (t->stream ? 4 : 0);
+	u_int len = t->inlen - (t->stream ? 4 : 0);
+	unsigned short port = 0;
+	enum clnt_stat stat;
+
+	if (t->step == SW_PMAP) {
+		stat = rpc_decode(p, len, (xdrproc_t)xdr_u_short, &port);
+		close(t->fd);
+		t->fd = -1;
+		if (stat != RPC_SUCCESS || port == 0)
+			sw_done(t, "rpc");
+		else
+			sw_call(t, SW_NFS, port);
+		return;
+	}
+	stat = rpc_decode(p, len, (xdrproc_t)xdr_void, NULL);
+	t->rtt = now_ms() - t->sent;
+	sw_done(t, stat == RPC_SUCCESS ? NULL : "rpc");
+}
+
+static void
+sw_io(t)
+/*
+ * The socket of t is ready: connected, or a reply or error is there
+ */
+struct sw_target *t;
+{
+	socklen_t errlen;
+	int err = 0, n;
+	u_int32_t mark;
+
+	if (t->connecting) {
+		errlen = sizeof(err);
+		if (getsockopt(t->fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen) < 0)
+			err = errno;
+		if (err) {
+			sw_done(t, sock_fail(t->fd, &err));
+			return;
+		}
+		t->connecting = 0;
+		sw_send(t);
+		return;
+	}
+	n = recv(t->fd, t->in + t->inlen, sizeof(t->in) - t->inlen, 0);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n <= 0) {
+		err = n < 0 ? errno : ECONNRESET;
+		sw_done(t, sock_fail(t->fd, &err));
+		return;
+	}
+	if (!t->stream) {
+		if (n >= 4 && ntohl(*(u_int32_t *)t->in) == t->xid) {
+			t->inlen = n;
+			sw_reply(t);
+		}
+		return;
+	}
+	t->inlen += n;
+	if (t->inlen < 4)
+		return;
+	memcpy(&mark, t->in, 4);
+	mark = ntohl(mark) & 0x7fffffff;
+	if (t->inlen >= 4 + mark)
+		sw_reply(t);
+	else if (t->inlen == sizeof(t->in))
+		sw_done(t, "rpc");	/* more than a NULL reply */
+}
+
+static void
+sw_timer(t, now)
+/*
+ * Time is up for the step of t, or its UDP call is due again
+ */
+struct sw_target *t;
+long now;
+{
+	if (now >= t->deadline)
+		sw_done(t, "timeout");
+	else if (!t->stream)
+		sw_send(t);
+}
+
+static void *
+sw_loop(arg)
+/*
+ * One event loop, working through its share of the servers
+ */
+void *arg;
+{
+	struct sw_loop *l = arg;
+	struct sw_target **active, *t;
+	struct pollfd *pfd;
+	size_t i, n, nactive = 0;
+	int next = 0;
+	long now, wait, due;
+
+#ifdef linux
+	if (l->cpu >= 0) {
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(l->cpu, &cpus);
+		(void) pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+#endif
+	assert(l->inflight > 0);
+	active = xalloc(l->inflight * sizeof(*active));
+	pfd = xalloc(l->inflight * sizeof(*pfd));
+	for (;;) {
+		while (nactive < l->inflight && next < l->n) {
+			t = l->t[next++];
+			sw_start(t);
+			if (t->step != SW_DONE)
+				active[nactive++] = t;
+		}
+		if (nactive == 0)
+			break;
+		now = now_ms();
+		wait = 1000;
+		for (i = 0; i < nactive; i++) {
+			t = active[i];
+			pfd[i].fd = t->fd;
+			pfd[i].events = t->events;
+			pfd[i].revents = 0;
+			due = t->deadline;
+			if (!t->stream && t->resend < due)
+				due = t->resend;
+			if (due - now < wait)
+				wait = due - now;
+		}
+		if (poll(pfd, nactive, wait > 0 ? wait : 0) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		now = now_ms();
+		for (i = n = 0; i < nactive; i++) {
+			t = active[i];
+			if (pfd[i].revents)
+				sw_io(t);
+			else if (now >= t->deadline ||
+				 (!t->stream && now >= t->resend))
+				sw_timer(t, now);
+			if (t->step != SW_DONE)
+				active[n++] = t;
+		}
+		nactive = n;
+	}
+	free(active);
+	free(pfd);
+	return NULL;
+}
+
+int
+sweep(nloops)
+/*
+ * Probe all servers in the mount table with nloops event loops, or
+ * one per CPU if 0.  Return the number of servers down.
+ */
+int nloops;
+{
+	struct sw_target *t;
+	struct sw_loop *loops;
+	struct rlimit rl;
+	pthread_t *threads;
+	long ncpu = 1;
+	size_t inflight = SW_INFLIGHT;
+	int i, n;
+
+	t = sw_targets(&n);
+	if (n == 0) {
+		fprintf(stderr, "no NFS servers in mount table\n");
+		return 0;
+	}
+	if (!rpc_load())
+		return n;
+	/* getaddrinfo blocks, so not in the loops, where it would hold
+	   up every probe in flight */
+	for (i = 0; i < n; i++)
+		t[i].resolved = mount_addr(t[i].host, t[i].mount);
+#ifdef _SC_NPROCESSORS_ONLN
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		ncpu = 1;
+#endif
+	if (nloops <= 0)
+		nloops = ncpu;
+	if (nloops > n)
+		nloops = n;
+	/* a descriptor per probe in flight, within our limit */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		if (rl.rlim_cur < rl.rlim_max) {
+			rl.rlim_cur = rl.rlim_max;
+			(void) setrlimit(RLIMIT_NOFILE, &rl);
+			(void) getrlimit(RLIMIT_NOFILE, &rl);
+		}
+		if (rl.rlim_cur == RLIM_INFINITY)
+			;
+		else if (rl.rlim_cur < 32 + (rlim_t)nloops)
+			inflight = 1;
+		else if ((rl.rlim_cur - 32) / nloops < inflight)
+			inflight = (rl.rlim_cur - 32) / nloops;
+	}
+	if (vflg)
+		fprintf(stderr, "sweeping %d servers with %d loops, %lu probes each in flight\n",
+			n, nloops, (unsigned long)inflight);
+
+	loops = xalloc(nloops * sizeof(*loops));
+	threads = xalloc(nloops * sizeof(*threads));
+	for (i = 0; i < nloops; i++) {
+		loops[i].t = xalloc((n / nloops + 1) * sizeof(*loops[i].t));
+		loops[i].n = 0;
+		loops[i].inflight = inflight;
+		loops[i].cpu = ncpu > 1 ? i % ncpu : -1;
+	}
+	for (i = 0; i < n; i++)
+		loops[i % nloops].t[loops[i % nloops].n++] = &t[i];
+	for (i = 0; i < nloops; i++)
+		if (pthread_create(&threads[i], NULL, sw_loop, &loops[i]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	for (i = 0; i < nloops; i++)
+		pthread_join(threads[i], NULL);
+	return sw_down;
+}
+
+
+/*
+ * Good paths are saved and printed at the end, so that -o can put
+ * local and fast paths before slow ones.  Within a tier, the order
+ * of the arguments is kept.
+ */
+
+#define TIER_LOCAL	0
+#define TIER_FAST	1
+#define TIER_SLOW	2
+#define FAST_RTT	10	/* ms, servers answering within this are fast */
+
+static char **outpath;
+static int *outtier;
+static int nout, outsize;
+
+static int
+path_tier()
+/*
+ * Tier of the path chkpath just accepted
+ */
+{
+	if (!oflg || !path_remote)
+		return TIER_LOCAL;
+	return path_rtt <= FAST_RTT && path_oprtt <= FAST_RTT ?
+		TIER_FAST : TIER_SLOW;
+}
+
+static int
+tooslow(path)
+/*
+ * Return 1 if the path chkpath just accepted is on a server slower
+ * than -l allows
+ */
+char *path;
+{
+	if (!maxrtt || (path_rtt <= maxrtt && path_oprtt <= maxrtt))
+		return 0;
+	if (vflg)
+		fprintf(stderr, "%s: server answered in %ldms\n", path,
+			path_rtt > path_oprtt ? path_rtt : path_oprtt);
+	return 1;
+}
+
+static void
+output(path, tier)
+char *path;
+int tier;
+{
+	if (nout >= outsize) {
+		outsize += 32;
+		outpath = xrealloc(outpath, outsize * sizeof(char *));
+		outtier = xrealloc(outtier, outsize * sizeof(int));
+	}
+	outpath[nout] = xalloc(strlen(path) + 1);
+	strcpy(outpath[nout], path);
+	outtier[nout++] = tier;
+}
+
+static char **
+ordered_output(from, to)
+/*
+ * Return good paths from..to-1 in the order they are printed
+ */
+int from, to;
+{
+	char **paths = xalloc((to - from + 1) * sizeof(char *));
+	int i, tier, n = 0;
+
+	for (tier = TIER_LOCAL; tier <= TIER_SLOW; tier++)
+		for (i = from; i < to; i++)
+			if (outtier[i] == tier)
+				paths[n++] = outpath[i];
+	paths[n] = NULL;
+	return paths;
+}
+
+static int
+print_output(from, to)
+/*
+ * Print good paths from..to-1 on one line.  Return how many
+ */
+int from, to;
+{
+	char **paths = ordered_output(from, to);
+	int i;
+
+	for (i = 0; paths[i] != NULL; i++) {
+		if (i)
+			putchar(sflg ? ':' : ' ');
+		fputs(paths[i], stdout);
+	}
+	if (i)
+		putchar('\n');
+	free(paths);
+	return i;
+}
 
-	if (Hflg)
-		printf("%s ", p);
+/*
+ * Run a function over many directories from a few threads, so that
+ * the round trips to the NFS servers overlap.
+ */
 
-	/*
-	 * See if remote host already checked via another mount point
-	 */
-	for (mlist2 = firstmnt; mlist2 != NULL; mlist2 = mlist2->mlist_next)
-		if (strncmp(mlist2->mlist_fsname, p, len) == 0 
-				&& mlist2->mlist_checked)
-			return(mlist2->mlist_checked);
+#define PAR_THREADS	8
 
-	mlist->mlist_checked = -1; /* set failed */
-	if (vflg)
-		fprintf(stderr, "Checking %s..\n", p);
+static void (*par_fn)();
+static int par_n, par_next, par_done, par_gen;
+static long par_deadline;
+static pthread_mutex_t par_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	/*
-	 * Parse internet address
-	 */
-	if (!mlist->mountaddr) {
-		if (translate_hostname(p, mlist->proto, &mlist->mountaddr) == 0)
-			return 0;
-	}
+static void *
+par_worker(arg)
+void *arg;
+{
+	int i, gen;
 
-	if (mlist->proto) {
-                if (!chknfsmntproto(p, mlist->proto, mlist))
-			return 0;
-	} else {
-                if (!chknfsmntproto(p, IPPROTO_TCP, mlist) &&
-                    !chknfsmntproto(p, IPPROTO_UDP, mlist))
-			return 0;
+	pthread_mutex_lock(&par_lock);
+	gen = par_gen;
+	for (;;) {
+		if (gen != par_gen || par_next >= par_n ||
+		    (par_deadline && now_ms() >= par_deadline))
+			break;
+		i = par_next++;
+		pthread_mutex_unlock(&par_lock);
+		par_fn(i);
+		pthread_mutex_lock(&par_lock);
+		/* a late thread from an abandoned run doesn't count */
+		if (gen == par_gen)
+			par_done++;
 	}
-
-	mlist->mlist_checked = 1; /* set success */
-	if (vflg)
-		fprintf(stderr, "%s ok\n", p);
-	return 1;
+	pthread_mutex_unlock(&par_lock);
+	return NULL;
 }
 
-struct m_mlist *
-isnfsmnt(path)
+static void
+parallel(fn, n, budget)
 /*
- * Return 1 if path is NFS mount point
+ * Call fn(i) for i = 0..n-1 from up to PAR_THREADS threads.  With a
+ * budget in ms, return when it is spent even if some calls are stuck
+ * in the file system; those threads are abandoned.
  */
-char *path;
+void (*fn)();
+int n;
+long budget;
 {
-	struct m_mlist *mlist;
-	static int init;
+	pthread_t thread;
+	int i, started = 0, finished;
 
-	if (init == 0) {
-		++init;
-		mkm_mlist();
-	}
+	pthread_mutex_lock(&par_lock);
+	par_gen++;
+	par_fn = fn;
+	par_n = n;
+	par_next = par_done = 0;
+	par_deadline = budget ? now_ms() + budget : 0;
+	pthread_mutex_unlock(&par_lock);
 
-	if (Dflg)
-		fprintf(stderr, "isnfsmnt(%s)\n", path);
-	for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next) {
-		if (mlist->mlist_isnfs == 0)
-			continue;
-		if (strcmp(mlist->mlist_dir, path) == 0) {
-			if (Dflg)
-				fprintf(stderr, "%s: contained in %s mounted from %s\n",
-					path, mlist->mlist_dir, mlist->mlist_fsname);
-			return(mlist);
+	for (i = 0; i < PAR_THREADS && i < n; i++)
+		if (pthread_create(&thread, NULL, par_worker, NULL) == 0) {
+			pthread_detach(thread);
+			started++;
 		}
+	if (started == 0) {
+		/* no threads, do the work ourselves */
+		par_worker(NULL);
+		return;
+	}
+	for (;;) {
+		struct timeval tv;
+
+		pthread_mutex_lock(&par_lock);
+		finished = par_done == n ||
+			(par_deadline && now_ms() >= par_deadline);
+		pthread_mutex_unlock(&par_lock);
+		if (finished)
+			break;
+		tv.tv_sec = 0;
+		tv.tv_usec = 2000;
+		(void) select(0, NULL, NULL, NULL, &tv);
 	}
-	return NULL;
 }
 
-typedef void (*sighandler_t)(int);
+/*
+ * Cache warmup (-W).  Right after login, the first lookups in each
+ * NFS directory pay for fetching the directory and the attributes of
+ * its entries.  With the servers known to be alive, read the good
+ * directories and stat their entries in the background, so the
+ * client's caches are hot when the shell needs them.
+ */
 
-#define NTERMS 256
+static char **warm_dirs;
 
-jmp_buf alarmclock;
+static void
+warm(i)
+int i;
+{
+	DIR *dir;
+	struct dirent *de;
+	int dfd;
+
+	if ((dir = opendir(warm_dirs[i])) == NULL)
+		return;
+	dfd = dirfd(dir);
+	while ((de = readdir(dir)) != NULL) {
+		if (par_deadline && now_ms() >= par_deadline)
+			break;
+#if defined(STATX_BASIC_STATS) && defined(AT_NO_AUTOMOUNT)
+		{
+			struct statx stx;
+
+			(void) statx(dfd, de->d_name,
+				     AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
+				     STATX_TYPE|STATX_MODE, &stx);
+		}
+#else
+		{
+			struct stat stb;
+
+			(void) fstatat(dfd, de->d_name, &stb, AT_SYMLINK_NOFOLLOW);
+		}
+#endif
+	}
+	closedir(dir);
+}
 
 void
-sigalrm(signum)
-	int signum;
+warmup(dirs, ndirs, budget)
+char **dirs;
+int ndirs;
+long budget;
 {
+	long start = now_ms();
+
+	warm_dirs = dirs;
+	parallel(warm, ndirs, budget);
 	if (Dflg)
-		fprintf(stderr, "caught signal %d\n", signum);
-	longjmp(alarmclock, 1);
+		fprintf(stderr, "warmup of %d directories took %ldms\n",
+			ndirs, now_ms() - start);
 }
 
-int
-_chkpath(path, maxdepth)
-char *path;
-int maxdepth;
+/*
+ * Executable index (-x).  Once the good directories are known, list
+ * the executables in each of them, several directories at a time, and
+ * write a file mapping each command name to the first directory in
+ * path order that has it.  The file is meant to be mapped and binary
+ * searched (see -X), so a shell hook can find a command without
+ * walking NFS directories:
+ *
+ *	struct idx_header
+ *	uint32_t dir[ndirs]		string offsets of the directories
+ *	struct idx_entry entry[ncmds]	sorted by name
+ *	char strings[strsize]
+ */
+
+#define IDX_MAGIC	"CKNFSIX1"
+
+struct idx_header {
+	char magic[8];
+	uint32_t ndirs;
+	uint32_t ncmds;
+	uint32_t strsize;
+	uint32_t pad;
+};
+
+struct idx_entry {
+	uint32_t name;		/* string offset */
+	uint32_t dir;		/* index into dir[] */
+};
+
+struct idx_dir {
+	const char *path;
+	char **names;		/* executables found */
+	int nnames;
+};
+
+static struct idx_dir *idx_dirs;
+
+static void
+idx_add(d, name)
+struct idx_dir *d;
+const char *name;
+{
+	if ((d->nnames & 63) == 0)
+		d->names = xrealloc(d->names, (d->nnames + 64) * sizeof(char *));
+	d->names[d->nnames] = xalloc(strlen(name) + 1);
+	strcpy(d->names[d->nnames++], name);
+}
+
+static void
+idx_check(d, dfd, name)
+/*
+ * Add name to d if it's an executable file
+ */
+struct idx_dir *d;
+int dfd;
+const char *name;
 {
-	char *s, *s2;
-	int i, front=0, back=0;
 	struct stat stb;
-	struct m_mlist *mlist;
-	char p[MAXPATHLEN];
-	char symlink[MAXPATHLEN];
-	char *queue[NTERMS];
 
-	if (maxdepth == 0) {
-		fprintf(stderr,
-			"%s: Too many levels of symbolic links\n", path);
-		return 0;
-	}
-	/*
-	 * Copy path to working storage
-	 */
-	strncpy(p, path, sizeof(p)-1);
+	if (name[0] == '.' && (name[1] == '\0' ||
+			       (name[1] == '.' && name[2] == '\0')))
+		return;
+	if (fstatat(dfd, name, &stb, 0) < 0)
+		return;
+	if ((stb.st_mode & S_IFMT) == S_IFREG && (stb.st_mode & 0111))
+		idx_add(d, name);
+}
 
-	if (*p == '/') { /* If absolute path, start at root */
-		*prefix = '\0';
-		(void) chdir("/");
-	}
+static void
+idx_list(d)
+/*
+ * Find executables in one directory
+ */
+struct idx_dir *d;
+{
+	int dfd;
 
-	if (Dflg)
-		fprintf(stderr, "_chkpath(%s, %d) prefix=%s\n",
-			path, maxdepth, prefix);
-	/*
-	 * Put directory terms on FIFO queue
-	 */
-	for (s = strtok(p, "/"); s != NULL; s = strtok((char *)NULL, "/")) {
-		if (back >= NTERMS) {
-			fprintf(stderr, "Too many subdirs: %s\n", path);
-			goto fail;
-		}
-		queue[back++] = s;
+	if ((dfd = open(d->path, O_RDONLY|O_DIRECTORY)) < 0) {
+		if (vflg)
+			perror(d->path);
+		return;
 	}
-	/*  queue[front] = a, queue[front+1] = b, ... queue[back] = null */
-
-	/* The code below may make some unsafe calls to stat, so set
-	 * the alarm to catch problems.
-	 */
-	signal(SIGALRM, sigalrm);
-	alarm(timeout + 1);
-	if (setjmp(alarmclock))
-		goto fail;
+#if defined(linux) && defined(SYS_getdents64)
+	{
+		/* read the directory in big chunks, without the
+		   per-entry overhead of readdir */
+		struct linux_dirent64 {
+			uint64_t d_ino;
+			int64_t d_off;
+			unsigned short d_reclen;
+			unsigned char d_type;
+			char d_name[1];
+		} *de;
+		char buf[32768];
+		long n, off;
 
-	/*
-	 * Scan queue of directory terms, expanding 
-	 * symbolic links recursively.
-	 */
-	while (front != back) {
-		s = queue[front++];
-		/* Dot */
-		if (s[0] == '.' && s[1] == '\0')
-			continue;
-		/* Dot Dot */
-		if (s[0] == '.' && s[1] == '.' && s[2] == '\0') {
-			if (chdir("..") < 0) {
-				perror("chdir(..)");
-				goto fail;
+		while ((n = syscall(SYS_getdents64, dfd, buf, sizeof(buf))) > 0)
+			for (off = 0; off < n; off += de->d_reclen) {
+				de = (struct linux_dirent64 *)(buf + off);
+				/* only these can be executable files */
+				if (de->d_type == DT_REG || de->d_type == DT_LNK ||
+				    de->d_type == DT_UNKNOWN)
+					idx_check(d, dfd, de->d_name);
 			}
-			/* Remove trailing component of prefix */
-			if ((s2 = strrchr(prefix, '/')) != NULL)
-				*s2 = '\0';
-			continue;
-		} else {
-			(void) strcat(prefix, "/");
-			(void) strcat(prefix, s);
-		}
+	}
+#else
+	{
+		DIR *dir;
+		struct dirent *de;
 
-		if ((mlist = isnfsmnt(prefix)) != NULL) /* NFS mount? */
-			if (chknfsmnt(mlist) <= 0)
-				goto fail;
-		/* Check if symlink */
-		if (lstat(s, &stb) < 0) {
-			if (errno != ENOENT || !qflg)
-				perror(prefix);
-			goto fail;
-		}
-		if ((stb.st_mode & S_IFMT) != S_IFLNK) {
-			/* not symlink */
-			if (chdir(s) < 0) {
-				if (fflg) {
-					alarm(0);
-					return 1;
-				}
-				perror(prefix);
-				goto fail;
-			}
-			continue;
+		if ((dir = fdopendir(dup(dfd))) != NULL) {
+			while ((de = readdir(dir)) != NULL)
+				idx_check(d, dfd, de->d_name);
+			closedir(dir);
 		}
+	}
+#endif
+	close(dfd);
+}
 
-		/* Remove symlink from tail of prefix */
-		if ((s2 = strrchr(prefix, '/')) != NULL)
-			*s2 = '\0';
-		/* 
-		 * Read symlink
-		 */
-		if ((i = readlink(s, symlink, MAXPATHLEN-1)) < 0) {
-			perror(s);
-			goto fail;
-		}
-		symlink[i] = '\0'; /* null terminate */
+static void
+idx_one(i)
+int i;
+{
+	idx_list(&idx_dirs[i]);
+}
 
-		/*
-		 * Recursively check symlink
-		 */
+static const char *idx_strings;
 
-		if (_chkpath(symlink, maxdepth-1) == 0)
-			goto fail;
-	}
-	alarm(0);
-	return 1;
+static int
+idx_cmp(a, b)
+/*
+ * By name, then by position in path
+ */
+const void *a, *b;
+{
+	const struct idx_entry *ea = a, *eb = b;
+	int c = strcmp(idx_strings + ea->name, idx_strings + eb->name);
 
-fail:
-	alarm(0);
-	return 0;
+	if (c == 0)
+		c = ea->dir < eb->dir ? -1 : ea->dir > eb->dir;
+	return c;
 }
-	
-int
-chkpath(path)
+
+void
+write_index(file, dirs, ndirs)
 /*
- * Check path for accessibility.  Return 1 if ok, 0 if error
+ * Write index of the executables in dirs, which are in path order
  */
-char *path;
+char *file;
+char **dirs;
+int ndirs;
 {
-	char pwd[MAXPATHLEN];
-	int ret;
+	struct idx_header hdr;
+	struct idx_entry *ent;
+	uint32_t *diroff;
+	char *strings, tmp[MAXPATHLEN];
+	int i, j, n, nent = 0;
+	uint32_t strsize = 0, nstr;
+	FILE *fp;
 
-	if (Dflg)
-	    fprintf(stderr, "chkpath(%s)\n", path);
+	idx_dirs = xalloc(ndirs * sizeof(*idx_dirs) + 1);
+	memset(idx_dirs, 0, ndirs * sizeof(*idx_dirs));
+	for (i = 0; i < ndirs; i++)
+		idx_dirs[i].path = dirs[i];
+	parallel(idx_one, ndirs, 0L);
 
-	if (getcwd(pwd, sizeof(pwd)-1) == NULL) {
-	    perror("getcwd()");
-	    return 0;
+	/*
+	 * Lay out string table: directories first, then command names
+	 */
+	for (i = 0; i < ndirs; i++) {
+		strsize += strlen(dirs[i]) + 1;
+		for (j = 0; j < idx_dirs[i].nnames; j++)
+			strsize += strlen(idx_dirs[i].names[j]) + 1;
+		nent += idx_dirs[i].nnames;
 	}
-	if (*path != '/')   /* If not absolute path, get initial prefix */
-		strcpy(prefix, pwd);
+	strings = xalloc(strsize + 1);
+	diroff = xalloc(ndirs * sizeof(uint32_t) + 1);
+	ent = xalloc(nent * sizeof(*ent) + 1);
+	nstr = n = 0;
+	for (i = 0; i < ndirs; i++) {
+		diroff[i] = nstr;
+		strcpy(strings + nstr, dirs[i]);
+		nstr += strlen(dirs[i]) + 1;
+	}
+	for (i = 0; i < ndirs; i++)
+		for (j = 0; j < idx_dirs[i].nnames; j++) {
+			ent[n].name = nstr;
+			ent[n++].dir = i;
+			strcpy(strings + nstr, idx_dirs[i].names[j]);
+			nstr += strlen(idx_dirs[i].names[j]) + 1;
+			free(idx_dirs[i].names[j]);
+		}
+	idx_strings = strings;
+	qsort(ent, nent, sizeof(*ent), idx_cmp);
+	/* keep the first directory for each name */
+	for (i = j = 0; i < nent; i++)
+		if (j == 0 || strcmp(strings + ent[i].name,
+				     strings + ent[j-1].name) != 0)
+			ent[j++] = ent[i];
+	nent = j;
 
-	/* Allow maximum 64 levels of symbolic links */
-	ret = _chkpath(path, 64);
-	
-	/* "/" becomes "", crude fix */
-	if (prefix[0] == 0)
-		strcpy(prefix, "/");
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, IDX_MAGIC, sizeof(hdr.magic));
+	hdr.ndirs = ndirs;
+	hdr.ncmds = nent;
+	hdr.strsize = strsize;
 
-	/* restore cwd so relative paths work next time around */
-	chdir(pwd);
-	
-	return ret;
+	if ((fp = tmp_create(file, tmp, sizeof(tmp))) == NULL)
+		return;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(diroff, sizeof(uint32_t), ndirs, fp);
+	fwrite(ent, sizeof(*ent), nent, fp);
+	fwrite(strings, 1, strsize, fp);
+	if (fclose(fp) != 0 || rename(tmp, file) != 0) {
+		perror(file);
+		(void) unlink(tmp);
+	} else if (vflg)
+		fprintf(stderr, "%s: %d commands in %d directories\n",
+			file, nent, ndirs);
+	free(strings);
+	free(diroff);
+	free(ent);
+	for (i = 0; i < ndirs; i++)
+		free(idx_dirs[i].names);
+	free(idx_dirs);
 }
 
-/* Return point after '=' for opt in comma separated list */
-const char *
-find_opt_val(list, opt)
-	const char *list, *opt;
+int
+lookup_index(file, names, n)
+/*
+ * Print full path of each command in names from the index.
+ * Return number of commands not found, or -1 if no usable index
+ */
+char *file;
+char **names;
+int n;
 {
-	int optlen;
-	char *search;
-	const char *found;
+	const struct idx_header *hdr;
+	const struct idx_entry *ent;
+	const uint32_t *diroff;
+	const char *strings;
+	struct stat stb;
+	char *map;
+	size_t k;
+	int fd, i, lo, hi, mid, c, missing = 0;
 
-	optlen = strlen(opt);
-	search = xalloc(optlen + 2);
-	strcpy(search + 1, opt);
-	search[0] = ',';
-	search[optlen+1] = '=';
-	search[optlen+2] = 0;
-	/* First check for first argument */
-	if (strncmp(list, search+1, optlen+1) == 0)
-		return list + optlen + 1;
-	else if ((found = strstr(list, search)))
-		return found + optlen + 2;
-	else
-		return NULL;
+	if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &stb) < 0) {
+		perror(file);
+		return -1;
+	}
+	map = mmap(NULL, stb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED || stb.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "%s: cannot map index\n", file);
+		return -1;
+	}
+	hdr = (const struct idx_header *)map;
+	diroff = (const uint32_t *)(hdr + 1);
+	ent = (const struct idx_entry *)(diroff + hdr->ndirs);
+	strings = (const char *)(ent + hdr->ncmds);
+	if (memcmp(hdr->magic, IDX_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    sizeof(*hdr) + (size_t)hdr->ndirs * sizeof(*diroff) +
+	    (size_t)hdr->ncmds * sizeof(*ent) + hdr->strsize != stb.st_size ||
+	    hdr->strsize == 0 || strings[hdr->strsize - 1] != '\0') {
+		fprintf(stderr, "%s: not an index\n", file);
+		munmap(map, stb.st_size);
+		return -1;
+	}
+	for (k = 0; k < (size_t)hdr->ndirs + hdr->ncmds; k++)
+		if (k < hdr->ndirs ? diroff[k] >= hdr->strsize :
+		    ent[k - hdr->ndirs].name >= hdr->strsize ||
+		    ent[k - hdr->ndirs].dir >= hdr->ndirs) {
+			fprintf(stderr, "%s: corrupt index\n", file);
+			munmap(map, stb.st_size);
+			return -1;
+		}
+	for (i = 0; i < n; i++) {
+		lo = 0;
+		hi = hdr->ncmds;
+		c = 1;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if ((c = strcmp(names[i], strings + ent[mid].name)) == 0)
+				break;
+			if (c < 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (c == 0)
+			printf("%s/%s\n", strings + diroff[ent[mid].dir], names[i]);
+		else
+			++missing;
+	}
+	munmap(map, stb.st_size);
+	return missing;
 }
 
-char *
-copy_opt_val(list, opt)
-	const char *list, *opt;
+static int
+udp_schedule(list)
+/*
+ * Parse the -r list of ms to wait between UDP datagrams, the last
+ * one repeated until the timeout.  Return 0 if malformed
+ */
+	char *list;
 {
-	const char *start;
-	const char *comma;
-	int length;
-	char *copy;
-
-	if ((start = find_opt_val(list, opt)) == NULL)
-		return NULL;
+	char *s;
+	long ms;
 
-	if ((comma = strchr(start, ',')))
-		length = comma - start;
-	else
-		length = strlen(start);
-	copy = xalloc(length);
-	strncpy(copy, start, length);
-	return copy;
+	udp_nsched = 0;
+	for (s = strtok(list, ","); s != NULL; s = strtok(NULL, ",")) {
+		ms = atol(s);
+		if (ms <= 0 || udp_nsched >= UDP_SCHED_MAX)
+			return 0;
+		udp_sched[udp_nsched++] = ms;
+	}
+	return udp_nsched > 0;
 }
 
+static int
+slice(pending)
 /*
- * Begin machine dependent code for mount table 
+ * With -d, give the next path its share of what is left of the
+ * budget: an equal part for each of the pending paths, so earlier
+ * arguments are checked first and time they don't use goes to the
+ * later ones.  Return 1 if the budget is already spent.
  */
+int pending;
+{
+	long left;
 
-#if defined(sun) && defined(__SVR4)
-#include <sys/mnttab.h>
-void
-mkm_mlist()
+	if (!run_deadline)
+		return 0;
+	if ((left = run_deadline - now_ms()) <= 0)
+		return 1;
+	if (pending > 0)
+		slice_end = now_ms() + left / pending;
+	return 0;
+}
+
+static int good;	/* number of good paths */
+static int bad;		/* and of paths skipped */
+static int pending;	/* paths left, to share the -d budget between */
+static int pathvar_from, pathvar_to = -1; /* PATH's outputs with -a */
+
+static int
+count_paths(s, split)
 /*
- * Build list of mnt entries - Solaris version
+ * Return the number of paths check_list(s, split) gives a share of
+ * the -d budget, those that are checked
  */
+char *s;
+int split;
 {
-    FILE *mounted;
-    struct m_mlist *mlist;
-    struct mnttab mnt;
-    FILE *mounts = fopen(MNTTAB, "r");
-    int i;
-
-    if (mounts == NULL) {
-	perror(MNTTAB);
-	exit (1);
-    }
+	int n = 0;
 
-    do {
-	i = getmntent(mounts, &mnt);
-	if (i > 0) {
-	    fprintf (stderr, "%s: getmntent returns %d\n", MNTTAB, i);
-	    exit (1);
-	} 
-	if (i == -1) break;
-	mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
-	mlist->mlist_next = firstmnt;
-	mlist->mlist_checked = 0;
-	mlist->mlist_dir = xalloc(strlen(mnt.mnt_mountp)+1);
-	(void) strcpy(mlist->mlist_dir, mnt.mnt_mountp);
-	mlist->mlist_fsname = xalloc(strlen(mnt.mnt_special)+1);
-        (void) strcpy(mlist->mlist_fsname, mnt.mnt_special);
-        if (strcmp(mnt.mnt_fstype, "nfs") == 0 || strcmp(mnt.mnt_fstype, "nfs4") == 0) {
-	    mlist->mlist_isnfs = 1;
-	} else {
-	    mlist->mlist_isnfs = 0;
+	for (;;) {
+		if (*s != '.')
+			n++;
+		if (!split || (s = strchr(s, ':')) == NULL)
+			return n;
+		s++;
 	}
-	firstmnt = mlist;
-    } while (1);
-    (void) fclose(mounts);
 }
-#elif defined(sun) || defined(sgi) || defined(__hpux) || defined(NeXT) || defined(linux)
-#include <mntent.h>
-void
-mkm_mlist()
+
+static void
+check_list(s, split)
 /*
- * Build list of mnt entries - SunOS/IRIX/HP-UX/NeXTSTEP/Linux version
+ * Check one argument, a colon separated list of paths if split,
+ * and output the good ones
  */
+char *s;
+int split;
 {
-	FILE *mounted;
-	struct m_mlist *mlist;
-	struct mntent *mnt;
+	char *colon = NULL;
+	int late = 0;
 
-	if ((mounted = setmntent(MOUNTED, "r"))== NULL) {
-		perror(MOUNTED);
-		exit(1);
-	}
-	while ((mnt = getmntent(mounted)) != NULL) {
-                mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
-                memset(mlist, 0, sizeof(struct m_mlist));
-		mlist->mlist_pid = 0;
-		mlist->nfs_version = 0;
-                mlist->nfs_version = 0;
-                mlist->mountaddr = NULL;
-		/* remember the local automounter with funny entry.  Linux only? */
-		{
-			char dummy1[MAXPATHLEN];
-			int  pid;
+	do {
+		if (split) {
+			colon = strchr(s, ':');
+			if (colon) *colon = '\0';
+		}
 
-			if (sscanf(mnt->mnt_fsname, "%[^(](pid%d)",
-				   dummy1, &pid) == 2) {
-				mlist->mlist_pid = pid;
+		slice_cut = 0;
+		if (*s == '.') {
+			if (!eflg) {
+				good++;
+				output(s, TIER_LOCAL);
 			}
-                }
-                if (strncmp(mnt->mnt_type, "nfs", 3) == 0)
-		{
-                        const char *opt;
-
-                        if ((opt = find_opt_val(mnt->mnt_opts, "vers")))
-                                mlist->nfs_version = atoi(opt);
-                        else if ((opt = find_opt_val(mnt->mnt_opts, "nfsvers")))
-                                mlist->nfs_version = atoi(opt);
-                        if (opt && Dflg)
-				fprintf(stderr, "%s: NFS version is %d\n",
-					mnt->mnt_fsname, mlist->nfs_version);
-
-			if ((opt = find_opt_val(mnt->mnt_opts, "proto"))) {
-				if (Dflg)
-					fprintf(stderr, "%s: proto is at '%s'\n",
-						mnt->mnt_fsname, opt);
-				mlist->proto = strncmp(opt, "tcp", 3) == 0 ?
-					IPPROTO_TCP : IPPROTO_UDP;
-                        }
-
-			if ((opt = copy_opt_val(mnt->mnt_opts, "mountaddr")) ||
-			    (opt = copy_opt_val(mnt->mnt_opts, "addr"))) {
-				if (Dflg)
-					fprintf(stderr, "%s: mountaddr is %s\n",
-						mnt->mnt_fsname, opt);
-                                translate_address(opt, mlist->proto, &mlist->mountaddr);
+		} else if (!(late = slice(pending--)) &&
+			   chkpath(s) && !tooslow(s)) {
+			if (unique(prefix)) {
+				good++;
+				if (!eflg)
+					output(Lflg ? prefix : s, path_tier());
 			}
+		} else if (kflg && (late || slice_cut)) {
+			/* -d ran out before we could tell; only -o
+			   moves it behind the paths known to be fast */
+			good++;
+			if (!eflg)
+				output(s, oflg ? TIER_SLOW : TIER_LOCAL);
+			if (vflg)
+				fprintf(stderr, "path kept unchecked: %s\n", s);
+		} else {
+			bad++;
+			if (vflg)
+				fprintf(stderr, "path skipped: %s\n",
+					Lflg && *s != '.' ? prefix : s);
 		}
-		mlist->mlist_next = firstmnt;
-		mlist->mlist_checked = 0;
-		mlist->mlist_dir = xalloc(strlen(mnt->mnt_dir)+1);
-		(void) strcpy(mlist->mlist_dir, mnt->mnt_dir);
-		mlist->mlist_fsname = xalloc(strlen(mnt->mnt_fsname)+1);
-		(void) strcpy(mlist->mlist_fsname, mnt->mnt_fsname);
-		mlist->mlist_isnfs = !strcmp(mnt->mnt_type, MNTTYPE_NFS) ||
-			!strcmp(mnt->mnt_type, "nfs4") ||
-			(mlist->mlist_pid && !strcmp(mnt->mnt_type, "autofs"));
-		firstmnt = mlist;
-	}
-	(void) endmntent(mounted);
+		if (Gflg && *s != '.' && !late)
+			deps_print(s);
+		if (! colon)
+			break;	/* always taken if !split */
+		s = colon + 1;
+	} while (1);
 }
-#elif defined(ultrix)
-#include <sys/fs_types.h>
-#include <sys/mount.h>
-void
-mkm_mlist()
+
+static void
+put_quoted(s)
 /*
- * Build list of mnt entries - Ultrix version
+ * Print s for use inside single quotes, in sh as in csh
  */
+char *s;
 {
-	struct m_mlist *mlist;
-	struct fs_data fs_data;
-	int start=0, len;
+	for (; *s; s++)
+		if (*s == '\'')
+			fputs("'\\''", stdout);
+		else
+			putchar(*s);
+}
 
-	while ((len = getmnt(&start, &fs_data, sizeof(fs_data), 
-			NOSTAT_MANY, NULL)) > 0) {
-		mlist = (struct m_mlist *)xalloc(sizeof(*mlist));
-		mlist->mlist_next = firstmnt;
-		mlist->mlist_checked = 0;
-		mlist->mlist_dir = xalloc(strlen(fs_data.fd_path)+1);
-		(void) strcpy(mlist->mlist_dir, fs_data.fd_path);
-		mlist->mlist_fsname = 
-			xalloc(strlen(fs_data.fd_devname)+1);
-		(void) strcpy(mlist->mlist_fsname, fs_data.fd_devname);
-		mlist->mlist_isnfs = (fs_data.fd_fstype == GT_NFS);
-		firstmnt = mlist;
+static int
+var_name(s, len)
+/*
+ * Return 1 if the len characters at s make a shell variable name,
+ * which is all that is safe to print unquoted in an assignment
+ */
+const char *s;
+int len;
+{
+	int i;
+
+	if (len == 0 || isdigit((unsigned char)*s))
+		return 0;
+	for (i = 0; i < len; i++)
+		if (!isalnum((unsigned char)s[i]) && s[i] != '_')
+			return 0;
+	return 1;
+}
+
+static void
+assign(arg)
+/*
+ * -a: check the paths of NAME=list and print the assignment of the
+ * good ones to NAME, for sh with -s, else for csh
+ */
+char *arg;
+{
+	char *value = strchr(arg, '=');
+	char **paths;
+	int i, from = nout;
+
+	if (value == NULL || !var_name(arg, value - arg)) {
+		fprintf(stderr, "%s: not NAME=list\n", arg);
+		return;
 	}
-	if (len < 0) {
-		perror("getmnt");
-		exit(1);
+	*value++ = '\0';
+	unique(NULL);
+	if (*value)
+		check_list(value, 1);
+	if (strcmp(arg, "PATH") == 0) {
+		pathvar_from = from;
+		pathvar_to = nout;
 	}
+	if (eflg)
+		return;
+
+	if (sflg)
+		printf("%s='", arg);
+	else
+		printf("setenv %s '", arg);
+	paths = ordered_output(from, nout);
+	for (i = 0; paths[i] != NULL; i++) {
+		if (i)
+			putchar(':');
+		put_quoted(paths[i]);
+	}
+	free(paths);
+	if (sflg)
+		printf("'; export %s;\n", arg);
+	else
+		printf("';\n");
 }
-#elif defined (__osf__)
-#include <sys/mount.h>
-void
-mkm_mlist()
+
+/*
+ * Container mode (-n).  Each target process's mount namespace is
+ * checked in turn: its mount table is read from /proc/<pid>/mountinfo
+ * and paths are walked under /proc/<pid>/root, so they resolve as the
+ * process sees them.  Server outcomes are kept across namespaces by
+ * probe_server(), so a server mounted in fifty containers is probed
+ * once.  Probes go out from our own network namespace.
+ */
+
+#define NS_MAX	4096
+
+static int
+ns_targets(list, pids)
+/*
+ * Fill pids with one process per distinct mount namespace, from the
+ * comma separated list, or all of /proc if list is "all".  Return how
+ * many
+ */
+	char *list;
+	int *pids;
 {
-	struct statfs *fs;
-	int i;
-	int max;
-	struct m_mlist *mlist;
-	max = getfsstat ((struct statfs *)0, 0 , MNT_NOWAIT);
-	fs = (struct statfs *) xalloc (sizeof(struct statfs)*max);
-	max = getfsstat(fs, sizeof(struct statfs)*max, MNT_NOWAIT);
-	for (i = 0; i < max; i++) {
-		mlist = (struct m_mlist *)xalloc(sizeof(struct m_mlist));
-		mlist->mlist_next = firstmnt;
-		mlist->mlist_checked = 0;
-		mlist->mlist_dir = xalloc (strlen (fs[i].f_mntonname) + 1);
-		(void) strcpy (mlist->mlist_dir, fs[i].f_mntonname);
-		mlist->mlist_fsname = xalloc (strlen (fs[i].f_mntfromname) + 1);
-		(void) strcpy (mlist->mlist_fsname, fs[i].f_mntfromname);
-		mlist->mlist_isnfs = (fs[i].f_type == MOUNT_NFS);
-		firstmnt = mlist;
+	static struct { dev_t dev; ino_t ino; } seen[NS_MAX];
+	char file[64];
+	struct stat stb;
+	DIR *dir = NULL;
+	struct dirent *de;
+	char *s = NULL;
+	int pid, fd, i, n = 0;
+
+	if (strcmp(list, "all") == 0) {
+		if ((dir = opendir("/proc")) == NULL) {
+			perror("/proc");
+			return 0;
+		}
+	} else
+		s = strtok(list, ",");
+	while (n < NS_MAX) {
+		if (dir) {
+			if ((de = readdir(dir)) == NULL)
+				break;
+			if (!isdigit((unsigned char)de->d_name[0]))
+				continue;
+			pid = atoi(de->d_name);
+			/* kernel threads have an empty command line */
+			snprintf(file, sizeof(file), "/proc/%d/cmdline", pid);
+			if ((fd = open(file, O_RDONLY)) < 0)
+				continue;
+			i = read(fd, file, 1);
+			close(fd);
+			if (i != 1)
+				continue;
+		} else {
+			if (s == NULL)
+				break;
+			pid = atoi(s);
+			s = strtok(NULL, ",");
+		}
+		snprintf(file, sizeof(file), "/proc/%d/ns/mnt", pid);
+		if (stat(file, &stb) < 0) {
+			if (!dir)
+				perror(file);
+			continue;
+		}
+		for (i = 0; i < n; i++)
+			if (seen[i].dev == stb.st_dev && seen[i].ino == stb.st_ino)
+				break;
+		if (i < n)
+			continue;
+		seen[n].dev = stb.st_dev;
+		seen[n].ino = stb.st_ino;
+		pids[n++] = pid;
 	}
-	free((char *)fs);
+	if (dir)
+		closedir(dir);
+	return n;
 }
-#elif defined (__NetBSD__)
-#include <sys/mount.h>
-void
-mkm_mlist()
+
+static void
+ns_check(pid, paths, npaths)
 /*
- * Build list of mnt entries - 4.4BSD version
+ * Check paths, or if none all NFS mounts, in the mount namespace of
+ * pid and print "pid command: good paths..."
  */
+	int pid;
+	char **paths;
+	int npaths;
 {
-	struct statvfs *fs;
-	int i, max;
+	char comm[64], copy[MAXPATHLEN];
+	char **dirs;
 	struct m_mlist *mlist;
+	FILE *fp;
+	int i, n = 0, from = nout;
 
-	max = getmntinfo(&fs, ST_NOWAIT); /* use cached; do not query each file system */
+	snprintf(nsmtab, sizeof(nsmtab), "/proc/%d/mountinfo", pid);
+	snprintf(nsroot, sizeof(nsroot), "/proc/%d/root", pid);
+	if (access(nsmtab, R_OK) < 0 || access(nsroot, X_OK) < 0) {
+		perror(access(nsmtab, R_OK) < 0 ? nsmtab : nsroot);
+		nsroot[0] = nsmtab[0] = '\0';
+		return;
+	}
+	snprintf(comm, sizeof(comm), "/proc/%d/comm", pid);
+	if ((fp = fopen(comm, "r")) == NULL || fgets(comm, sizeof(comm), fp) == NULL)
+		strcpy(comm, "?\n");
+	if (fp)
+		fclose(fp);
+	comm[strcspn(comm, "\n")] = '\0';
 
-	for (i = 0; i < max; i++) {
-		mlist = (struct m_mlist *)xalloc(sizeof(struct m_mlist));
-		mlist->mlist_next = firstmnt;
-		mlist->mlist_checked = 0;
-		mlist->mlist_dir = xalloc (strlen (fs[i].f_mntonname) + 1);
-		(void) strcpy (mlist->mlist_dir, fs[i].f_mntonname);
-		mlist->mlist_fsname = xalloc (strlen (fs[i].f_mntfromname) + 1);
-		(void) strcpy (mlist->mlist_fsname, fs[i].f_mntfromname);
-		mlist->mlist_isnfs = (strcmp(fs[i].f_fstypename, "nfs") == 0);
-		firstmnt = mlist;
+	mlist_reset();
+	mlist_load();
+	unique(NULL);
+	if (npaths == 0) {
+		/* the namespace's own NFS mounts */
+		for (mlist = firstmnt; mlist != NULL; mlist = mlist->mlist_next)
+			n++;
+		dirs = xalloc((n + 1) * sizeof(char *));
+		for (mlist = firstmnt, n = 0; mlist != NULL; mlist = mlist->mlist_next)
+			if (mlist->mlist_isnfs && !mlist->mlist_pid)
+				dirs[n++] = mlist->mlist_dir;
+		/* not known before the table is read, so the mounts
+		   share what the namespaces before left of -d */
+		if (run_deadline)
+			pending += n;
+		/* the list is in reverse order of the table */
+		for (i = n - 1; i >= 0; i--) {
+			strncpy(copy, dirs[i], sizeof(copy) - 1);
+			copy[sizeof(copy) - 1] = '\0';
+			check_list(copy, 0);
+		}
+		free(dirs);
+	} else
+		for (i = 0; i < npaths; i++) {
+			strncpy(copy, paths[i], sizeof(copy) - 1);
+			copy[sizeof(copy) - 1] = '\0';
+			check_list(copy, sflg);
+		}
+	nsroot[0] = nsmtab[0] = '\0';
+
+	if (!eflg) {
+		printf("%d %s: ", pid, comm);
+		if (print_output(from, nout) == 0)
+			putchar('\n');
 	}
 }
-#else
-	UNDEFINED_mkm_mlist
-#endif
-
 
 int
 main(argc, argv)
@@ -1125,12 +7130,13 @@ char **argv;
 {
 	int n;
 	char *s;
-	int good = 0;
 	char outbuf[BUFSIZ];
 	char errbuf[BUFSIZ];
 	extern int optind;
 	extern char *optarg;
-	char **newargv;
+	char *lookup = NULL;
+	char *nstargets = NULL;
+	double budget = 0;
 
 	/*
 	 * Avoid intermixing stdout and stderr
@@ -1138,22 +7144,76 @@ char **argv;
 	setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
 	setvbuf(stderr, errbuf, _IOLBF, sizeof(errbuf));
 
-	while ((n = getopt(argc, argv, "efqst:uvDHL")) != EOF)
+	while ((n = getopt(argc, argv, "ac:d:efFg:Gi:j:kK:l:m:M:n:op:Pqr:RsS:t:uUvw:W:x:X:DHL")) != EOF)
 		switch(n) {
+			case 'a':	++aflg;
+					break;
+			case 'c':	recordfile = optarg;
+					break;
+			case 'd':	budget = atof(optarg);
+					break;
 			case 'e':	++eflg;
 					break;
 			case 'f':	++fflg;
 					break;
+			case 'F':	++Fflg;
+					break;
+			case 'g':	gossip = optarg;
+					break;
+			case 'G':	++Gflg;
+					++eflg;
+					break;
+			case 'i':	incfile = optarg;
+					break;
+			case 'j':	sweep_loops = atoi(optarg);
+					break;
+			case 'k':	++kflg;
+					break;
+			case 'K':	keyfile = optarg;
+					break;
+			case 'l':	maxrtt = atol(optarg);
+					break;
+			case 'm':	snapfile = optarg;
+					break;
+			case 'M':	mtab = optarg;
+					break;
+			case 'n':	nstargets = optarg;
+					break;
+			case 'o':	++oflg;
+					break;
+			case 'p':	replayfile = optarg;
+					break;
+			case 'P':	++Pflg;
+					break;
 			case 'q':	++qflg;
 					break;
+			case 'r':	if (!udp_schedule(optarg))
+						++errflg;
+					break;
+			case 'R':	++Rflg;
+					break;
 			case 's':	++sflg;
 					break;
+			case 'S':	statedir = optarg;
+					break;
 			case 't':	timeout = atoi(optarg);
 					break;
 			case 'u':	++uflg;
 					break;
+			case 'U':	++Uflg;
+					break;
 			case 'v':	++vflg;
 					break;
+			case 'W':	warmbudget = atol(optarg);
+					break;
+			case 'x':	indexfile = optarg;
+					break;
+			case 'X':	lookup = optarg;
+					break;
+			case 'w':	interval = atoi(optarg);
+					if (interval <= 0)
+						++errflg;
+					break;
 			case 'D':	++Dflg; ++vflg;
 					break;
 			case 'H':	++Hflg;
@@ -1163,69 +7223,157 @@ char **argv;
 			default:	++errflg;
 		}
 
-	if (argc <= optind && !eflg) /* no paths */
+	if (argc <= optind && !eflg && !interval && !nstargets && !Fflg) /* no paths */
+		++errflg;
+	if (Pflg && (interval || Fflg)) /* never get to the report */
 		++errflg;
+	if (nstargets && (aflg || mtab || indexfile || warmbudget))
+		++errflg;	/* one PATH, table, index for all namespaces */
 
 	if (errflg) {
-		fprintf(stderr, "Usage: %s -e -f -q -s -t# -u -v -D -L paths\n",
+		fprintf(stderr, "Usage: %s -d# -e -f -G -i file -k -l# -m file -M file -o -P -q -r#,# -R -s -t# -u -U -v -D -L paths\n",
 			argv[0]);
+		fprintf(stderr, "       %s -a [-s] NAME=path:path... ...\n", argv[0]);
+		fprintf(stderr, "       %s -n pid,...|all [options] [paths]\n", argv[0]);
+		fprintf(stderr, "       %s -w# [-t#] [-S dir] [-g port,dest:port... -K keyfile]\n", argv[0]);
+		fprintf(stderr, "       %s -F [-j#] [-t#] [-M file]\n", argv[0]);
+		fprintf(stderr, "       %s -X index commands\n", argv[0]);
 		fprintf(stderr, "\tCheck paths for dead NFS servers\n");
 		fprintf(stderr, "\tGood paths are printed to stdout\n\n");
+		fprintf(stderr, "\t -a\tcheck NAME=list arguments, print assignments\n");
+		fprintf(stderr, "\t -c file\trecord server probe outcomes in file\n");
+		fprintf(stderr, "\t -d s\tfinish within s seconds, fractions allowed\n");
 		fprintf(stderr, "\t -e\tsilent, do not print paths\n");
 		fprintf(stderr, "\t -f\taccept ordinary files\n");
+		fprintf(stderr, "\t -F\tprobe every NFS server in the mount table, print each\n");
+		fprintf(stderr, "\t -g spec\twith -w, gossip verdicts: [addr:]port,dest:port,...\n");
+		fprintf(stderr, "\t -G\tprint the NFS mounts each path depends on\n");
+		fprintf(stderr, "\t -i file\trecheck incrementally, keeping state in file\n");
+		fprintf(stderr, "\t -j n\twith -F, n event loops (one per CPU)\n");
+		fprintf(stderr, "\t -k\tkeep paths not checked when -d runs out\n");
+		fprintf(stderr, "\t -K file\tkey for signing gossip\n");
+		fprintf(stderr, "\t -l ms\tskip paths on servers slower than ms\n");
+		fprintf(stderr, "\t -m file\tkeep a snapshot of the parsed mount table in file\n");
+		fprintf(stderr, "\t -M file\tread mount table (mtab or mountinfo) from file\n");
+		fprintf(stderr, "\t -n pids\tcheck in the mount namespaces of pids, or all\n");
+		fprintf(stderr, "\t -o\tprint local and fast paths before slow ones\n");
+		fprintf(stderr, "\t -p file\ttake server probe outcomes from file\n");
+		fprintf(stderr, "\t -P\tprofile: counters per phase on stderr\n");
 		fprintf(stderr, "\t -q\tquiet, omit diagnostics about missing files\n");
+		fprintf(stderr, "\t -r ms,..\twait between UDP retransmits (250,500,1000)\n");
+		fprintf(stderr, "\t -R\talso probe with a real NFS operation\n");
 		fprintf(stderr, "\t -s\tprint paths in sh format (semicolons)\n");
+		fprintf(stderr, "\t -S dir\tremember dead servers in dir between runs\n");
 		fprintf(stderr, "\t -t n\ttimeout interval before assuming an NFS\n");
 		fprintf(stderr, "\t\tserver is dead (default 5 seconds)\n");
 		fprintf(stderr, "\t -u\tunique paths\n");
+		fprintf(stderr, "\t -U\twalk all paths at once with io_uring\n");
 		fprintf(stderr, "\t -v\tverbose\n");
+		fprintf(stderr, "\t -w n\twatch all NFS servers, probing every n seconds\n");
+		fprintf(stderr, "\t -W ms\twarm up caches of good paths for at most ms\n");
+		fprintf(stderr, "\t -x file\twrite index of executables in good paths\n");
+		fprintf(stderr, "\t -X file\tlook up commands in index\n");
 		fprintf(stderr, "\t -D\tdebug\n");
 		fprintf(stderr, "\t -H\tprint host pinged\n");
 		fprintf(stderr, "\t -L\texpand symbolic links\n\n");
 		exit(1);
 	}
 
-	if (uflg)
-		newargv = (char **) xalloc((argc - optind) * sizeof(char *));
+	if (Pflg)
+		prof_start();
 
-	for (n = optind; n < argc; ++n) {
-		char *colon = NULL;
+	if (lookup) {
+		n = lookup_index(lookup, argv + optind, argc - optind);
+		(void) fflush(stdout);
+		prof_report();
+		exit(n != 0);
+	}
 
-		s = argv[n];
-		do {
-			if (sflg) {
-				colon = strchr(s, ':');
-				if (colon) *colon = '\0';
-			}
+	if (statedir && mkdir(statedir, 0755) < 0 && errno != EEXIST) {
+		perror(statedir);
+		statedir = NULL;
+	}
 
-			if (*s == '.') {
-				if (!eflg) {
-					if (good++)
-						putchar(sflg ? ':' : ' ');
-					fputs(s, stdout);
-				}
-			} else if (chkpath(s)) {
-				if (unique(prefix)) {
-					if (good++ && !eflg)
-						putchar(sflg ? ':' : ' ');
-					if (!eflg)
-						fputs(Lflg ? prefix : s, stdout);
-				}
-			} else {
-				if (uflg)
-					newargv[n - optind] = NULL;
-				if (vflg)
-					fprintf(stderr, "path skipped: %s\n",
-						Lflg && *s != '.' ? prefix : s);
-			}
-			if (! colon)
-				break;	/* always taken if !sflg */
-			s = colon + 1;
-		} while (1);
+	if (Fflg) {
+		n = sweep(sweep_loops);
+		(void) fflush(stdout);
+		exit(n != 0);
 	}
 
-	if (good && !eflg)
-		putchar('\n');
+	if (interval)
+		watch(interval);
+
+	if (budget > 0) {
+		run_deadline = now_ms() + (long)(budget * 1000);
+		/* count the paths to share the budget between */
+		for (n = optind; n < argc; ++n)
+			if (!aflg)
+				pending += count_paths(argv[n], sflg);
+			else if ((s = strchr(argv[n], '=')) != NULL &&
+				 var_name(argv[n], s - argv[n]) && s[1])
+				pending += count_paths(s + 1, 1);
+	}
+
+	if (nstargets) {
+		int *pids = xalloc(NS_MAX * sizeof(int));
+		int i, npids = ns_targets(nstargets, pids);
+
+		pending *= npids;	/* the paths, in each namespace */
+		for (i = 0; i < npids; i++)
+			ns_check(pids[i], argv + optind, argc - optind);
+		(void) fflush(stdout);
+		prof_report();
+		exit(npids == 0 || bad > 0);
+	}
+
+	/* servers the paths needed last time, before any other I/O */
+	inc_load();
+	deps_load();
+	if (deps_on && !inc_on) {
+		mlist_load();
+		slice_end = run_deadline;
+		arg_paths(argv + optind, argc - optind, deps_prefetch, NULL);
+		slice_end = 0;
+	}
+
+	prof_enter(PROF_WALK);
+	if (Uflg && !ur_batch(argv + optind, argc - optind) && vflg)
+		fprintf(stderr, "io_uring not available, walking paths one at a time\n");
+
+	for (n = optind; n < argc; ++n)
+		if (aflg)
+			assign(argv[n]);
+		else
+			check_list(argv[n], sflg);
+	prof_leave();
+
+	prof_enter(PROF_OUTPUT);
+	if (!aflg)
+		print_output(0, nout);
+	(void) fflush(stdout);
+	prof_leave();
+	if (deps_on)
+		deps_write();
+	if (inc_on)
+		inc_write();
+	prof_report();
+
+	if ((indexfile || warmbudget) && nout > 0 && (!aflg || pathvar_to > pathvar_from) &&
+	    background() == 0) {
+		char **paths = aflg ? ordered_output(pathvar_from, pathvar_to)
+				    : ordered_output(0, nout);
+		int i, n;
+
+		/* only absolute paths make sense after we're gone */
+		for (i = n = 0; paths[i] != NULL; i++)
+			if (paths[i][0] == '/')
+				paths[n++] = paths[i];
+		if (warmbudget)
+			warmup(paths, n, warmbudget);
+		if (indexfile)
+			write_index(indexfile, paths, n);
+		_exit(0);
+	}
 
 	(void) fflush(stderr);
 	(void) fflush(stdout);